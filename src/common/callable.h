@@ -3,25 +3,18 @@
 #include <memory>
 #include <vector>
 
+#include "gc_object.h"
 #include "object.h"
 
-namespace interpreter
-{
-class Interpreter;
-} // namespace interpreter
-
 namespace common
 {
 
-template <typename T>
-using Ptr = std::shared_ptr<T>;
-
-class ICallable
+class ICallable: public GcObject
 {
 public:
   virtual ~ICallable() {}
 
-  virtual Object Call(interpreter::Interpreter& interpreter, std::vector<Object>& args) const
+  virtual Object Call(std::vector<Object>& args) const
   {
     throw std::logic_error("Call() not implemented.");
   }
@@ -33,7 +26,9 @@ public:
     throw std::logic_error("GetArity() not implemented.");
   }
 
-  virtual Ptr<ICallable> Bind(const std::string& name, common::Object arg) const
+  // Copy of this callable with instance bound to "this", allocated on the
+  // same heap.
+  virtual ICallable* Bind(common::Object instance) const
   {
     throw std::logic_error("Bind() not implemented.");
   }
@@ -43,9 +38,9 @@ template <typename T, size_t A>
 class BuiltinCallable: public ICallable
 {
 public:
-  Object Call(interpreter::Interpreter& interpreter, std::vector<Object>& args) const override
+  Object Call(std::vector<Object>& args) const override
   {
-    return T(interpreter, args);
+    return T(args);
   }
 
   size_t GetArity() const override
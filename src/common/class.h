@@ -3,6 +3,7 @@
 #include <string>
 
 #include "callable.h"
+#include "symbol.h"
 
 namespace common
 {
@@ -14,7 +15,8 @@ class IClass: public ICallable
 public:
   virtual ~IClass() {}
 
-  virtual std::shared_ptr<common::Object> FindMethod(const std::string&) const = 0;
+  // nullptr if neither the class nor its superclasses define the method.
+  virtual const Object* FindMethod(Symbol) const = 0;
   
 };
 
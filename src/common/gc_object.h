@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace common
+{
+
+class Heap;
+
+// Base of everything a Heap manages. Managed objects reference each other
+// through raw pointers and report those references from Trace().
+class GcObject
+{
+public:
+  virtual ~GcObject() {}
+
+  virtual void Trace(Heap& heap) const {}
+
+  // Bytes the object owns outside of itself, such as the characters of a
+  // string, so that collections keep up with the memory actually in use.
+  virtual size_t GetPayloadSize() const { return 0; }
+
+private:
+  friend class Heap;
+
+  GcObject* next_ = nullptr;
+  uint32_t size_ = 0;
+  // Always set for permanent objects, so marking never writes to them.
+  mutable bool marked_ = false;
+};
+
+} // namespace common
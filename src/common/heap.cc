@@ -0,0 +1,66 @@
+#include "heap.h"
+
+#include <algorithm>
+
+namespace common
+{
+
+Heap::~Heap()
+{
+  while (objects_)
+  {
+    GcObject* next = objects_->next_;
+    delete objects_;
+    objects_ = next;
+  }
+}
+
+void Heap::Collect()
+{
+  trace_roots_(*this);
+  for (const Object* obj: temp_roots_)
+  {
+    Mark(*obj);
+  }
+  for (const std::vector<Object>* objs: temp_vector_roots_)
+  {
+    for (const Object& obj: *objs)
+    {
+      Mark(obj);
+    }
+  }
+  for (const GcObject* obj: temp_gc_object_roots_)
+  {
+    Mark(obj);
+  }
+
+  while (!gray_.empty())
+  {
+    const GcObject* obj = gray_.back();
+    gray_.pop_back();
+    obj->Trace(*this);
+  }
+
+  size_t live = 0;
+  GcObject** link = &objects_;
+  while (*link)
+  {
+    GcObject* obj = *link;
+    if (obj->marked_)
+    {
+      obj->marked_ = false;
+      live += obj->size_ + obj->GetPayloadSize();
+      link = &obj->next_;
+    }
+    else
+    {
+      *link = obj->next_;
+      delete obj;
+    }
+  }
+
+  bytes_allocated_ = live;
+  next_collection_ = std::max(kInitialThreshold, live * kGrowthFactor);
+}
+
+} // namespace common
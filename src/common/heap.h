@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gc_object.h"
+#include "object.h"
+
+namespace common
+{
+
+// Precise mark-sweep heap. Collections only happen at Safepoint(), which the
+// interpreters call where every live object is reachable from the roots
+// reported by the root tracer or from a Root guard.
+class Heap
+{
+public:
+  using RootTracer = std::function<void(Heap&)>;
+
+  // Keeps values held in C++ locals alive while code that may reach a
+  // safepoint runs. Guards must be destroyed in LIFO order, as scopes are.
+  class Root
+  {
+  public:
+    Root(Heap& heap, const Object& obj)
+      : heap_(heap),
+        kind_(Kind::OBJECT)
+    {
+      heap_.temp_roots_.push_back(&obj);
+    }
+
+    Root(Heap& heap, const std::vector<Object>& objs)
+      : heap_(heap),
+        kind_(Kind::VECTOR)
+    {
+      heap_.temp_vector_roots_.push_back(&objs);
+    }
+
+    Root(Heap& heap, const GcObject* obj)
+      : heap_(heap),
+        kind_(Kind::GC_OBJECT)
+    {
+      heap_.temp_gc_object_roots_.push_back(obj);
+    }
+
+    Root(const Root&) = delete;
+    Root& operator=(const Root&) = delete;
+
+    ~Root()
+    {
+      switch (kind_)
+      {
+        case Kind::OBJECT:
+          heap_.temp_roots_.pop_back();
+          break;
+        case Kind::VECTOR:
+          heap_.temp_vector_roots_.pop_back();
+          break;
+        case Kind::GC_OBJECT:
+          heap_.temp_gc_object_roots_.pop_back();
+          break;
+      }
+    }
+
+  private:
+    enum class Kind
+    {
+      OBJECT,
+      VECTOR,
+      GC_OBJECT
+    };
+
+    Heap& heap_;
+    Kind kind_;
+  };
+
+  explicit Heap(RootTracer trace_roots)
+    : trace_roots_(std::move(trace_roots))
+  {}
+
+  Heap(const Heap&) = delete;
+  Heap& operator=(const Heap&) = delete;
+
+  ~Heap();
+
+  template <typename T, typename ... Args>
+  T* Allocate(Args&& ... args)
+  {
+    T* obj = new T(std::forward<Args>(args)...);
+    obj->next_ = objects_;
+    obj->size_ = sizeof(T);
+    objects_ = obj;
+    bytes_allocated_ += sizeof(T) + obj->GetPayloadSize();
+    return obj;
+  }
+
+  // Accounts for bytes an object allocated after it was created, e.g. by
+  // growing a vector. Collections recompute the sizes of live objects.
+  void Grow(size_t bytes)
+  {
+    bytes_allocated_ += bytes;
+  }
+
+  // Object owned by the caller instead of a heap and never collected, such
+  // as a literal embedded in the AST. Safe to share between heaps.
+  template <typename T, typename ... Args>
+  static std::unique_ptr<T> MakePermanent(Args&& ... args)
+  {
+    auto obj = std::make_unique<T>(std::forward<Args>(args)...);
+    obj->marked_ = true;
+    return obj;
+  }
+
+  // Same for an object whose storage the caller manages otherwise, e.g. in
+  // an arena.
+  static void MarkPermanent(GcObject* obj)
+  {
+    obj->marked_ = true;
+  }
+
+  Object MakeString(std::string value)
+  {
+    return Object(Object::STRING, Allocate<String>(std::move(value)));
+  }
+
+  void Safepoint()
+  {
+    if (bytes_allocated_ >= next_collection_)
+    {
+      Collect();
+    }
+  }
+
+  void Collect();
+
+  void Mark(const GcObject* obj)
+  {
+    if (obj && !obj->marked_)
+    {
+      obj->marked_ = true;
+      gray_.push_back(obj);
+    }
+  }
+
+  void Mark(const Object& obj)
+  {
+    Mark(obj.GetGcObject());
+  }
+
+private:
+  static constexpr size_t kInitialThreshold = 1 << 20;
+  static constexpr size_t kGrowthFactor = 2;
+
+  RootTracer trace_roots_;
+  // Intrusive list of every allocated object, linked through next_.
+  GcObject* objects_ = nullptr;
+  size_t bytes_allocated_ = 0;
+  size_t next_collection_ = kInitialThreshold;
+  std::vector<const GcObject*> gray_;
+  std::vector<const Object*> temp_roots_;
+  std::vector<const std::vector<Object>*> temp_vector_roots_;
+  std::vector<const GcObject*> temp_gc_object_roots_;
+};
+
+} // namespace common
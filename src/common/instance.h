@@ -2,19 +2,23 @@
 
 #include <string>
 
+#include "gc_object.h"
 #include "object.h"
+#include "symbol.h"
 
 namespace common
 {
 
-class IInstance
+class IInstance: public GcObject
 {
 public:
   virtual ~IInstance() {};
 
   virtual std::string GetTypeName() const = 0;
 
-  virtual Object& Get(const std::string&, bool) = 0;
+  virtual Object Get(Symbol) = 0;
+
+  virtual void Set(Symbol, Object) = 0;
 };
 
 } // namespace common
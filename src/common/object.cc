@@ -7,54 +7,58 @@
 namespace common
 {
 
-std::string ToStringImpl(const std::string& val)
+ICallable& Object::AsCallable() const
 {
-  return val;
+  if (type_ == CLASS)
+  {
+    return *static_cast<IClass*>(ptr_);
+  }
+  AssumeType(CALLABLE);
+  return *static_cast<ICallable*>(ptr_);
 }
 
-std::string ToStringImpl(const std::shared_ptr<ICallable>& val)
+IClass& Object::AsClass() const
 {
-  return "<callable: " + val->GetName() + ">";
+  AssumeType(CLASS);
+  return *static_cast<IClass*>(ptr_);
 }
 
-std::string ToStringImpl(const std::shared_ptr<IClass>& val)
+IInstance& Object::AsInstance() const
 {
-  return "<class: " + val->GetName() + ">";
+  AssumeType(INSTANCE);
+  return *static_cast<IInstance*>(ptr_);
 }
 
-std::string ToStringImpl(const std::shared_ptr<IInstance>& val)
+std::string Object::ToString() const
 {
-  return "<instance of: " + val->GetTypeName() + ">";
-}
-
-ICallable& Object::AsCallable() const
+  switch (type_)
   {
-    if (type_ == CLASS)
-    {
-      return *held_->As<std::shared_ptr<IClass>>();
-    }
-    AssumeType(CALLABLE);
-    return *held_->As<std::shared_ptr<ICallable>>();
+    case INT: return std::to_string(int_);
+    case FLOAT: return std::to_string(float_);
+    case BOOLEAN: return std::to_string(bool_);
+    case STRING:
+    case IDENTIFIER: return AsString();
+    case CALLABLE: return "<callable: " + AsCallable().GetName() + ">";
+    case CLASS: return "<class: " + AsClass().GetName() + ">";
+    case INSTANCE: return "<instance of: " + AsInstance().GetTypeName() + ">";
+    case NONE: return "None";
   }
+  throw std::logic_error("Object::ToString() Bad type");
+}
 
 Object MakeInt(int64_t val)
 {
-  return Object(Object::INT, val);
+  return Object(val);
 }
 
 Object MakeFloat(double val)
 {
-  return Object(Object::FLOAT, val);
-}
-
-Object MakeString(const std::string& val)
-{
-  return Object(Object::STRING, val);
+  return Object(val);
 }
 
 Object MakeBool(bool val)
 {
-  return Object(Object::BOOLEAN, val);
+  return Object(val);
 }
 
 Object MakeNone()
@@ -62,17 +66,17 @@ Object MakeNone()
   return Object();
 }
 
-Object MakeCallable(std::shared_ptr<common::ICallable> val)
+Object MakeCallable(ICallable* val)
 {
   return Object(Object::CALLABLE, val);
 }
 
-Object MakeClass(std::shared_ptr<common::IClass> val)
+Object MakeClass(IClass* val)
 {
   return Object(Object::CLASS, val);
 }
 
-Object MakeInstance(std::shared_ptr<common::IInstance> val)
+Object MakeInstance(IInstance* val)
 {
   return Object(Object::INSTANCE, val);
 }
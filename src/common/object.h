@@ -1,11 +1,10 @@
 #pragma once
 
-#include <memory>
+#include <cstdint>
 #include <stdexcept>
-#include <type_traits>
+#include <string>
 
-// #include "callable.h"
-// #include "iclass.h"
+#include "gc_object.h"
 
 namespace common
 {
@@ -14,19 +13,20 @@ class ICallable;
 class IClass;
 class IInstance;
 
-template <typename T>
-decltype(std::to_string(T())) ToStringImpl(const T& val)
+class String: public GcObject
 {
-  return std::to_string(val);
-}
-
-std::string ToStringImpl(const std::string& val);
-
-std::string ToStringImpl(const std::shared_ptr<ICallable>& val);
+public:
+  explicit String(std::string value)
+    : value_(std::move(value))
+  {}
 
-std::string ToStringImpl(const std::shared_ptr<IClass>& val);
+  size_t GetPayloadSize() const override
+  {
+    return value_.capacity();
+  }
 
-std::string ToStringImpl(const std::shared_ptr<IInstance>& val);
+  std::string value_;
+};
 
 class Object
 {
@@ -44,13 +44,15 @@ public:
     NONE
   };
 
-  Object() : type_(NONE), held_(nullptr) {}
+  Object() : type_(NONE), int_(0) {}
 
-  template <typename T>
-  Object(Type type, T val) : type_(type), held_(std::make_shared<Holder<T>>(val))
-  {}
+  explicit Object(int64_t val) : type_(INT), int_(val) {}
+
+  explicit Object(double val) : type_(FLOAT), float_(val) {}
 
-  virtual ~Object() {}
+  explicit Object(bool val) : type_(BOOLEAN), bool_(val) {}
+
+  Object(Type type, GcObject* ptr) : type_(type), ptr_(ptr) {}
 
   void AssumeType(Type type) const
   {
@@ -60,43 +62,35 @@ public:
     }
   }
 
-  int64_t& AsInt() const
+  int64_t AsInt() const
   {
     AssumeType(INT);
-    return held_->As<int64_t>();
+    return int_;
   }
 
-  double& AsFloat() const
+  double AsFloat() const
   {
     AssumeType(FLOAT);
-    return held_->As<double>();
+    return float_;
   }
 
   std::string& AsString() const
   {
     AssumeType(STRING);
-    return held_->As<std::string>();
+    return static_cast<String*>(ptr_)->value_;
   }
 
-  bool& AsBool() const
+  bool AsBool() const
   {
     AssumeType(BOOLEAN);
-    return held_->As<bool>();
+    return bool_;
   }
 
   ICallable& AsCallable() const;
 
-  IClass& AsClass() const
-  {
-    AssumeType(CLASS);
-    return *held_->As<std::shared_ptr<IClass>>();
-  }
+  IClass& AsClass() const;
 
-  IInstance& AsInstance() const
-  {
-    AssumeType(INSTANCE);
-    return *held_->As<std::shared_ptr<IInstance>>();
-  }
+  IInstance& AsInstance() const;
 
   std::string GetTypeName()
   {
@@ -120,14 +114,7 @@ public:
     return "Bad type: " + std::to_string(type);
   }
 
-  std::string ToString() const
-  {
-    if (type_ == NONE)
-    {
-      return "None";
-    }
-    return held_->ToString();
-  }
+  std::string ToString() const;
 
   Type GetType() const
   {
@@ -163,52 +150,37 @@ public:
     
   }
 
+  // Managed object this one refers to, if any.
+  GcObject* GetGcObject() const
+  {
+    switch (type_)
+    {
+      case STRING:
+      case CALLABLE:
+      case CLASS:
+      case INSTANCE:
+        return ptr_;
+      default:
+        return nullptr;
+    }
+  }
+
   bool IsNumber() const
   {
     return (type_ == INT) || (type_ == FLOAT);
   }
 
 private:
-  class AbstractHolder
-  {
-  public:
-    virtual ~AbstractHolder() {}
-
-    template <typename T>
-    T& As()
-    {
-      Holder<T>* ptr = dynamic_cast<Holder<T>*>(this);
-      if (ptr == nullptr)
-      {
-        throw std::logic_error("Bad object cast");
-      }
-      return ptr->GetValue();
-    }
-
-    virtual std::string ToString() const = 0;
-  };
-
-  template <typename T>
-  class Holder: public AbstractHolder
+  // Ints, floats and bools live inline; STRING, CALLABLE, CLASS and INSTANCE
+  // objects point to an object owned by a common::Heap (or a permanent one).
+  Type type_;
+  union
   {
-  public:
-    Holder() = delete;
-    Holder(T held) : held_(held)
-    {}
-
-    T& GetValue() { return held_; }
-
-    std::string ToString() const override
-    {
-      return ToStringImpl(held_);
-    }
-
-  private:
-    T held_;
+    int64_t int_;
+    double float_;
+    bool bool_;
+    GcObject* ptr_;
   };
-
-  Type type_;
-  std::shared_ptr<AbstractHolder> held_;
 };
 
 
@@ -216,17 +188,15 @@ Object MakeInt(int64_t val);
 
 Object MakeFloat(double val);
 
-Object MakeString(const std::string& val);
-
 Object MakeBool(bool val);
 
 Object MakeNone();
 
-Object MakeCallable(std::shared_ptr<common::ICallable> val);
+Object MakeCallable(ICallable* val);
 
-Object MakeClass(std::shared_ptr<common::IClass> val);
+Object MakeClass(IClass* val);
 
-Object MakeInstance(std::shared_ptr<common::IInstance> val);
+Object MakeInstance(IInstance* val);
 
 
 } // namespace common
@@ -0,0 +1,47 @@
+#include "symbol.h"
+
+#include <mutex>
+
+namespace common
+{
+
+SymbolTable& SymbolTable::Get()
+{
+  static SymbolTable table;
+  return table;
+}
+
+SymbolTable::SymbolTable()
+{
+  Intern("this");
+  Intern("super");
+  Intern("__init");
+}
+
+Symbol SymbolTable::Intern(std::string_view name)
+{
+  {
+    // Most names are already there, so look them up without excluding the
+    // other threads.
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = symbols_.find(name);
+    if (it != symbols_.end())
+    {
+      return it->second;
+    }
+  }
+
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  auto it = symbols_.find(name);
+  if (it != symbols_.end())
+  {
+    return it->second;
+  }
+
+  names_.emplace_back(name);
+  Symbol symbol = static_cast<Symbol>(names_.size() - 1);
+  symbols_.emplace(names_.back(), symbol);
+  return symbol;
+}
+
+} // namespace common
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace common
+{
+
+// Interned identifier. Equal names always map to the same symbol, so runtime
+// maps can key on symbols instead of hashing strings.
+using Symbol = uint32_t;
+
+namespace symbols
+{
+
+// Interned first by SymbolTable, in this order.
+constexpr Symbol kThis = 0;
+constexpr Symbol kSuper = 1;
+constexpr Symbol kInit = 2;
+
+constexpr Symbol kNone = static_cast<Symbol>(-1);
+
+} // namespace symbols
+
+// Shared by every thread; front ends of several modules intern names
+// concurrently.
+class SymbolTable
+{
+public:
+  static SymbolTable& Get();
+
+  Symbol Intern(std::string_view name);
+
+  const std::string& GetName(Symbol symbol) const
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return names_[symbol];
+  }
+
+private:
+  SymbolTable();
+
+  mutable std::shared_mutex mutex_;
+  // Keys point into names_, which never relocates its elements.
+  std::unordered_map<std::string_view, Symbol> symbols_;
+  std::deque<std::string> names_;
+};
+
+inline Symbol Intern(std::string_view name)
+{
+  return SymbolTable::Get().Intern(name);
+}
+
+inline const std::string& GetSymbolName(Symbol symbol)
+{
+  return SymbolTable::Get().GetName(symbol);
+}
+
+} // namespace common
@@ -12,7 +12,7 @@ public:
   void Visit(const parser::Binary& expr) override
   {
     std::stringstream ss;
-    ss << "(" << expr.op_->ToRawString() << " ";
+    ss << "(" << expr.op_.ToRawString() << " ";
     ss << GetValue(*expr.left_) << " " << GetValue(*expr.right_) << ")";
     Return(ss.str());
   }
@@ -32,7 +32,7 @@ public:
   void Visit(const parser::Unary& expr) override
   {
     std::stringstream ss;
-    ss << "(" << expr.op_->ToRawString() << " " << GetValue(*expr.right_) << ")";
+    ss << "(" << expr.op_.ToRawString() << " " << GetValue(*expr.right_) << ")";
     Return(ss.str());
   }
 };
\ No newline at end of file
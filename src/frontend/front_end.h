@@ -0,0 +1,329 @@
+#pragma once
+
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "optimizer/optimizer.h"
+#include "parser/id_allocator.h"
+#include "parser/parser.h"
+#include "parser/program.h"
+#include "resolver/module_loader.h"
+#include "resolver/resolution.h"
+#include "resolver/resolver.h"
+#include "scanner/scanner.h"
+#include "scanner/token_source.h"
+#include "util/diagnostics.h"
+#include "util/file_stamp.h"
+#include "util/mapped_file.h"
+#include "util/source_file.h"
+#include "util/thread_pool.h"
+
+namespace frontend
+{
+
+// Takes a program from source text to resolved and optimized modules: the
+// main script and every script it imports, directly or not. Imported scripts
+// are parsed on a thread pool as the imports naming them are found, and then
+// resolved there once every module is parsed, so modules that do not depend
+// on each other go through the front end side by side. Each module is loaded
+// once however often it is imported. A lazy front end skips the bodies of
+// top-level functions and methods and completes each one when an engine
+// first calls it, so that loading costs what runs rather than what is
+// declared. Errors do not stop the front end: every module is parsed and
+// resolved, and what is wrong with all of them is reported at the end.
+class FrontEnd: public resolver::IModuleLoader
+{
+public:
+  // file was read from path; imports are looked up next to it. Errors are
+  // reported to err. Imports are mapped into memory unless copy_imports is
+  // set, for a program that is kept while its files may change.
+  FrontEnd(const util::SourceFile& file,
+           std::string path,
+           bool lazy,
+           std::ostream& err = std::cerr,
+           bool copy_imports = false)
+    : kFile(file),
+      kPath(std::move(path)),
+      kLazy(lazy),
+      kCopyImports(copy_imports),
+      err_(err)
+  {}
+
+  // False if the program has errors, which have been reported.
+  bool Run()
+  {
+    modules_.push_back(std::make_unique<Module>(kPath));
+    modules_.front()->source = &kFile;
+    indices_.emplace(std::filesystem::path(kPath).lexically_normal().string(), 0);
+    Parse(*modules_.front(), true);
+
+    // Modules are appended as they are found, so this visits every module
+    // once its parse is done. Only this thread touches modules_.
+    std::unique_ptr<util::ThreadPool> pool;
+    for (size_t i = 0; i < modules_.size(); ++i)
+    {
+      Module& module = *modules_[i];
+      if (module.parsed.valid())
+      {
+        module.parsed.get();
+      }
+      AddImports(module, pool);
+    }
+
+    resolution_ = resolver::Resolution(ids_.GetNumIds());
+    if (!pool)
+    {
+      Resolve(*modules_.front());
+    }
+    else
+    {
+      std::vector<std::future<void>> resolved;
+      for (const auto& module: modules_)
+      {
+        resolved.push_back(pool->Submit([this, m = module.get()] { Resolve(*m); }));
+      }
+      for (auto& r: resolved)
+      {
+        r.get();
+      }
+    }
+
+    // Reported here rather than as they are found, so that the output does
+    // not depend on which thread got to which module first.
+    bool ok = true;
+    for (const auto& module: modules_)
+    {
+      Report(*module, 0);
+      ok = ok && module->diagnostics.Empty();
+    }
+    return ok;
+  }
+
+  parser::Program& GetProgram() { return modules_.front()->program; }
+
+  // True if the main script imports other modules.
+  bool HasImports() const { return modules_.size() > 1; }
+
+  // Files of the imported modules as they were before they were read,
+  // including those that could not be opened.
+  std::vector<util::FileStamp> GetImportStamps() const
+  {
+    std::vector<util::FileStamp> stamps;
+    for (size_t i = 1; i < modules_.size(); ++i)
+    {
+      stamps.push_back(modules_[i]->stamp);
+    }
+    return stamps;
+  }
+
+  // Summed over the modules.
+  optimizer::Stats GetOptimizerStats() const
+  {
+    optimizer::Stats stats;
+    for (const auto& module: modules_)
+    {
+      const optimizer::Stats& s = module->optimizer->GetStats();
+      stats.folded += s.folded;
+      stats.groupings += s.groupings;
+      stats.short_circuits += s.short_circuits;
+      stats.dead_branches += s.dead_branches;
+    }
+    return stats;
+  }
+
+  bool Load(const parser::stmt::Func& func) override
+  {
+    Module& module = *FindModule(func.name_.GetLexeme().data());
+
+    // Engines see the tree as const, but it belongs to the module.
+    parser::stmt::Func& node = const_cast<parser::stmt::Func&>(func);
+
+    // The body was lexed without errors when it was skipped.
+    size_t num_diagnostics = module.diagnostics.Size();
+    scanner::Scanner scanner(*module.source, module.diagnostics, func.skipped_->begin, func.skipped_->end);
+    parser::Parser parser(*module.source, scanner, module.diagnostics);
+    if (parser.ParseSkippedBody(node, module.program))
+    {
+      node.skipped_ = nullptr;
+      module.resolver->ResolveSkipped(func);
+    }
+    if (module.diagnostics.Size() != num_diagnostics)
+    {
+      Report(module, num_diagnostics);
+      return false;
+    }
+
+    module.optimizer->Optimize(func);
+    return true;
+  }
+
+  const resolver::Resolution& GetResolution() const override { return resolution_; }
+
+  util::Span<parser::stmt::Stmt*> GetStatements(size_t module) const override
+  {
+    return modules_[module]->program.GetStatements();
+  }
+
+  const std::vector<resolver::Export>& GetExports(size_t module) const override
+  {
+    return modules_[module]->exports;
+  }
+
+  const util::SourceFile* FindFile(const char* pos) const override
+  {
+    const Module* module = FindModule(pos);
+    return module ? module->source : nullptr;
+  }
+
+private:
+  // Imported modules are named by their file, with this extension.
+  static constexpr const char* kExtension = ".inp";
+
+  struct Module
+  {
+    explicit Module(std::string p)
+      : path(std::move(p))
+    {}
+
+    std::string path;
+    // Taken before an imported module is read.
+    util::FileStamp stamp;
+    // The text of imported modules; the main script's belongs to the caller.
+    util::MappedFile file;
+    std::unique_ptr<util::SourceFile> owned_source;
+    const util::SourceFile* source = nullptr;
+    // Pending Parse() of imported modules.
+    std::future<void> parsed;
+    parser::Program program;
+    // Kept for the bodies of lazy functions.
+    std::unique_ptr<resolver::Resolver> resolver;
+    std::unique_ptr<optimizer::Optimizer> optimizer;
+    std::vector<resolver::Export> exports;
+    // Only touched by the thread working on the module.
+    util::Diagnostics diagnostics;
+  };
+
+  const util::SourceFile& kFile;
+  const std::string kPath;
+  const bool kLazy;
+  const bool kCopyImports;
+  std::ostream& err_;
+  std::vector<std::unique_ptr<Module>> modules_;
+  // Index in modules_ by normalized path.
+  std::unordered_map<std::string, size_t> indices_;
+  parser::IdAllocator ids_;
+  resolver::Resolution resolution_;
+
+  // Runs on the pool for imported modules.
+  void Parse(Module& module, bool is_main)
+  {
+    // The parser pulls tokens straight from the scanner, unless the main
+    // script is large enough to lex up front on spare cores.
+    const util::SourceFile& source = *module.source;
+    scanner::Scanner scanner(source, module.diagnostics);
+    scanner::ITokenSource* tokens = &scanner;
+    std::unique_ptr<scanner::TokenVectorSource> lexed;
+    if (is_main && source.GetText().size() >= scanner::Scanner::kParallelThreshold &&
+        std::thread::hardware_concurrency() > 1)
+    {
+      util::ThreadPool pool;
+      lexed = std::make_unique<scanner::TokenVectorSource>(scanner.GetTokens(pool), scanner.GetLiterals());
+      tokens = lexed.get();
+    }
+
+    parser::Parser parser(source, *tokens, module.diagnostics, &ids_, kLazy);
+    module.program = parser.Parse();
+  }
+
+  // Numbers the imports of module and starts parsing the modules they name
+  // for the first time.
+  void AddImports(Module& module, std::unique_ptr<util::ThreadPool>& pool)
+  {
+    std::filesystem::path dir = std::filesystem::path(module.path).parent_path();
+    for (parser::stmt::Stmt* stmt: module.program.GetStatements())
+    {
+      auto import = dynamic_cast<parser::stmt::Import*>(stmt);
+      if (!import)
+      {
+        continue;
+      }
+
+      std::string path = (dir / (import->name_.ToRawString() + kExtension)).lexically_normal().string();
+      auto [it, inserted] = indices_.emplace(path, modules_.size());
+      import->module_ = it->second;
+      if (!inserted)
+      {
+        continue;
+      }
+
+      auto imported = std::make_unique<Module>(path);
+      imported->stamp = util::FileStamp::Take(path);
+      bool opened = kCopyImports ? imported->file.Read(path.c_str()) : imported->file.Open(path.c_str());
+      if (!opened)
+      {
+        // The module stays without a source, as an empty one.
+        module.diagnostics.Report("IMPORT", import->name_.GetPosition(*module.source), "Can not open " + path);
+      }
+      else
+      {
+        imported->owned_source = std::make_unique<util::SourceFile>(imported->file.GetContents());
+        imported->source = imported->owned_source.get();
+        if (!pool)
+        {
+          pool = std::make_unique<util::ThreadPool>();
+        }
+        imported->parsed = pool->Submit([this, m = imported.get()] { return Parse(*m, false); });
+      }
+      modules_.push_back(std::move(imported));
+    }
+  }
+
+  // Runs on the pool when there are imported modules. Modules with errors
+  // are resolved for their diagnostics but left unoptimized, since they do
+  // not run.
+  void Resolve(Module& module)
+  {
+    if (!module.source)
+    {
+      module.optimizer = std::make_unique<optimizer::Optimizer>(module.program);
+      return;
+    }
+    module.resolver = std::make_unique<resolver::Resolver>(*module.source, resolution_, module.diagnostics);
+    module.resolver->Resolve(module.program.GetStatements());
+    module.exports = module.resolver->GetExports();
+
+    module.optimizer = std::make_unique<optimizer::Optimizer>(module.program);
+    if (module.diagnostics.Empty())
+    {
+      module.optimizer->Optimize();
+    }
+  }
+
+  // Prints the diagnostics of module from the one at begin on. Those of
+  // imported modules name their file.
+  void Report(const Module& module, size_t begin) const
+  {
+    module.diagnostics.Print(err_, begin, module.source == &kFile ? "" : module.path);
+  }
+
+  Module* FindModule(const char* pos) const
+  {
+    for (const auto& module: modules_)
+    {
+      if (module->source && module->source->Contains(pos))
+      {
+        return module.get();
+      }
+    }
+    return nullptr;
+  }
+};
+
+} // namespace frontend
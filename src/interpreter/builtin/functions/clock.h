@@ -18,7 +18,7 @@ public:
   using Clock = std::chrono::system_clock;
   using Units = std::chrono::milliseconds;
 
-  common::Object Call(interpreter::Interpreter& interpreter, std::vector<common::Object>& args) const override
+  common::Object Call(std::vector<common::Object>& args) const override
   {
     int64_t num_millis = std::chrono::duration_cast<Units>(Clock::now().time_since_epoch()).count();
     return common::MakeInt(num_millis);
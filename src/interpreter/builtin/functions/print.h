@@ -1,6 +1,6 @@
 #pragma once
 
-#include <iostream>
+#include <ostream>
 
 #include "common/object.h"
 #include "common/callable.h"
@@ -15,9 +15,13 @@ namespace functions
 class PrintBuiltin: public common::ICallable
 {
 public:
-  common::Object Call(interpreter::Interpreter& interpreter, std::vector<common::Object>& args) const override
+  explicit PrintBuiltin(std::ostream& out)
+    : out_(out)
+  {}
+
+  common::Object Call(std::vector<common::Object>& args) const override
   {
-    std::cout << args[0].ToString() << "\n";
+    out_ << args[0].ToString() << "\n";
     return common::MakeNone();
   }
 
@@ -30,6 +34,9 @@ public:
   {
     return 1;
   }
+
+private:
+  std::ostream& out_;
 };
 
 } // namespace functions
@@ -4,32 +4,39 @@
 #include <vector>
 #include <unordered_map>
 
+#include "common/heap.h"
 #include "common/object.h"
 #include "common/class.h"
 #include "instance_impl.h"
+#include "shape.h"
 
 namespace interpreter
 {
 
-class Interpreter;
-
 class ClassImpl: public common::IClass
 {
 public:
-  using Methods = std::unordered_map<std::string, std::shared_ptr<common::Object>>;
+  using Methods = std::unordered_map<common::Symbol, common::Object>;
 
-  ClassImpl(const std::string& name, common::Object super, Methods& methods)
+  // Instances start with the fields of root_shape.
+  ClassImpl(common::Heap& heap,
+            const std::string& name,
+            common::Object super,
+            Methods& methods,
+            std::unique_ptr<Shape> root_shape = std::make_unique<Shape>())
     : kName(name),
+      heap_(heap),
       methods_(std::move(methods)),
-      super_(super)
+      super_(super),
+      root_shape_(std::move(root_shape))
   {}
 
-  std::shared_ptr<common::Object> FindMethod(const std::string& name) const override
+  const common::Object* FindMethod(common::Symbol name) const override
   {
     auto it = methods_.find(name);
     if (it != methods_.end())
     {
-      return it->second;
+      return &it->second;
     }
     if (super_.GetType() == common::Object::CLASS)
     {
@@ -43,21 +50,30 @@ public:
     return kName;
   }
 
-  common::Object Call(interpreter::Interpreter& interpreter, std::vector<common::Object>& args) const override
+  common::Object Call(std::vector<common::Object>& args) const override
   {
-    auto ptr = std::make_shared<InstanceImpl>(self_.lock());
-    common::Object obj = common::MakeInstance(ptr);
-    auto init = FindMethod("__init");
+    common::Object obj = NewInstance({});
+    auto init = FindMethod(common::symbols::kInit);
     if (init)
     {
-      init->AsCallable().Bind("this", obj)->Call(interpreter, args);
+      common::Heap::Root obj_root(heap_, obj);
+      common::Object bound = common::MakeCallable(init->AsCallable().Bind(obj));
+      common::Heap::Root bound_root(heap_, bound);
+      bound.AsCallable().Call(args);
     }
     return obj;
   }
 
+  // An instance with fields for the fields of the root shape, without
+  // running "__init".
+  common::Object NewInstance(std::vector<common::Object> fields) const
+  {
+    return common::MakeInstance(heap_.Allocate<InstanceImpl>(this, root_shape_.get(), std::move(fields)));
+  }
+
   size_t GetArity() const override
   {
-    auto init = FindMethod("__init");
+    auto init = FindMethod(common::symbols::kInit);
     if (init)
     {
       return init->AsCallable().GetArity();
@@ -65,16 +81,27 @@ public:
     return 0;
   }
 
-  void SetSelf(std::weak_ptr<ClassImpl> self)
+  const Shape& GetRootShape() const
   {
-    self_ = self;
+    return *root_shape_;
+  }
+
+  void Trace(common::Heap& heap) const override
+  {
+    heap.Mark(super_);
+    for (const auto& method: methods_)
+    {
+      heap.Mark(method.second);
+    }
   }
 
 private:
   const std::string kName;
+  common::Heap& heap_;
   Methods methods_;
-  std::weak_ptr<ClassImpl> self_;
   common::Object super_;
+  // Instances start here and transition as fields are assigned.
+  const std::unique_ptr<Shape> root_shape_;
 };
 
 } // namespace interpreter
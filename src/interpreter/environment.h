@@ -1,24 +1,24 @@
 #pragma once
 
-#include <unordered_map>
-#include <string>
 #include <vector>
 #include <memory>
 
+#include "common/gc_object.h"
+#include "common/heap.h"
 #include "common/object.h"
 #include "interpret_error.h"
 
 namespace interpreter
 {
   
-class Environment
+class Environment: public common::GcObject
 {
 public:
   Environment()
     : parent_env_(nullptr)
   {}
 
-  Environment(std::shared_ptr<Environment> parent_env)
+  Environment(Environment* parent_env)
     : parent_env_(parent_env)
   {
   }
@@ -27,39 +27,131 @@ public:
   {
   }
 
-  void Define(const std::string& name, common::Object obj)
+  // Variables are defined in the same order the resolver assigned their
+  // slots, so the slot of a new variable is the current number of slots.
+  // Growing the slots is accounted to heap.
+  size_t Define(common::Object obj, common::Heap& heap)
   {
-    if (env_.find(name) != env_.end())
+    size_t capacity = slots_.capacity();
+    slots_.push_back(obj);
+    if (slots_.capacity() != capacity)
     {
-      throw std::runtime_error(name + " is already defined.");
+      heap.Grow((slots_.capacity() - capacity) * sizeof(common::Object));
     }
-    env_[name] = obj;
+    return slots_.size() - 1;
   }
 
-  common::Object& GetAt(const std::string& name, size_t depth)
+  common::Object& GetAt(size_t depth, size_t slot)
   {
-    if (depth)
+    Environment* env = this;
+    while (depth--)
     {
-      return GetParentEnvironment()->GetAt(name, depth - 1);
+      env = env->parent_env_;
     }
-    auto it = env_.find(name);
-    if (it != env_.end())
+    if (slot >= env->slots_.size())
     {
-      return it->second;
+      throw std::runtime_error("Variable is not defined.");
     }
-    throw std::runtime_error(name + " is not defined.");
+    return env->slots_[slot];
   }
 
-  std::shared_ptr<Environment> GetParentEnvironment()
+  Environment* GetParentEnvironment()
   {
     return parent_env_;
   }
 
+  // Empties the environment for reuse, keeping the slot storage.
+  void Reset(Environment* parent_env)
+  {
+    slots_.clear();
+    parent_env_ = parent_env;
+  }
+
+  size_t GetPayloadSize() const override
+  {
+    return slots_.capacity() * sizeof(common::Object);
+  }
+
+  void Trace(common::Heap& heap) const override
+  {
+    heap.Mark(parent_env_);
+    for (const common::Object& obj: slots_)
+    {
+      heap.Mark(obj);
+    }
+  }
+
 private:
-  std::unordered_map<std::string, common::Object> env_;
-  std::shared_ptr<Environment> parent_env_;
+  std::vector<common::Object> slots_;
+  Environment* parent_env_;
 };
 
+// LIFO pool of environments for scopes no closure can capture (see
+// parser::stmt::Func::kHasClosures). Pooled environments are permanent
+// objects outside the heap and keep their slot storage between uses, so
+// entering such a scope does not allocate once the pool is warm. The active
+// ones are GC roots.
+class FrameStack
+{
+public:
+  Environment* Push(Environment* parent_env)
+  {
+    if (size_ == envs_.size())
+    {
+      envs_.push_back(common::Heap::MakePermanent<Environment>());
+    }
+    Environment* env = envs_[size_++].get();
+    env->Reset(parent_env);
+    return env;
+  }
+
+  // Restores the size the stack had at construction, also when unwinding.
+  class Guard
+  {
+  public:
+    Guard(FrameStack& stack)
+      : stack_(stack),
+        size_(stack.Size())
+    {}
+
+    ~Guard()
+    {
+      stack_.Truncate(size_);
+    }
+
+  private:
+    FrameStack& stack_;
+    size_t size_;
+  };
+
+  void Pop()
+  {
+    --size_;
+  }
+
+  size_t Size() const { return size_; }
+
+  // Releases every environment pushed after the stack had size entries.
+  void Truncate(size_t size)
+  {
+    size_ = size;
+  }
+
+  void Trace(common::Heap& heap) const
+  {
+    // Permanent objects are never marked, trace them directly.
+    for (size_t i = 0; i < size_; ++i)
+    {
+      envs_[i]->Trace(heap);
+    }
+  }
+
+private:
+  std::vector<std::unique_ptr<Environment>> envs_;
+  size_t size_ = 0;
+};
+
+// Environments of the running code; every entry is a GC root.
 class EnvironmentStack
 {
 public:
@@ -68,39 +160,33 @@ public:
   public:
     Guard() = delete;
 
-    Guard(EnvironmentStack& stack, std::shared_ptr<Environment> other)
-      : stack_(stack),
-        old_(stack.GetCurrent())
+    Guard(EnvironmentStack& stack, Environment* other)
+      : stack_(stack)
     {
-      stack_.SetCurrent(other);
+      stack_.envs_.push_back(other);
     }
 
     Guard(EnvironmentStack& stack)
-      : Guard(stack, std::make_shared<Environment>(stack.GetCurrent()))
+      : Guard(stack, stack.heap_.Allocate<Environment>(stack.GetCurrent()))
     {}
 
     ~Guard()
     {
-      stack_.SetCurrent(old_);
+      stack_.envs_.pop_back();
     }
 
   private:
     EnvironmentStack& stack_;
-    std::shared_ptr<Environment> old_;
   };
 
-  EnvironmentStack()
-    : top_(std::make_shared<Environment>())
+  EnvironmentStack(common::Heap& heap)
+    : heap_(heap),
+      envs_{heap.Allocate<Environment>()}
   {}
 
-  std::shared_ptr<Environment> GetCurrent()
+  Environment* GetCurrent()
   {
-    return top_;
-  }
-
-  void SetCurrent(std::shared_ptr<Environment> env)
-  {
-    top_ = env;
+    return envs_.back();
   }
 
   std::unique_ptr<Guard> GetGuard()
@@ -108,23 +194,27 @@ public:
     return std::make_unique<Guard>(*this);
   }
 
-  std::unique_ptr<Guard> GetGuard(std::shared_ptr<Environment> other)
+  std::unique_ptr<Guard> GetGuard(Environment* other)
   {
     return std::make_unique<Guard>(*this, other);
   }
 
-  std::shared_ptr<Environment> GetRoot()
+  Environment* GetRoot()
+  {
+    return envs_.front();
+  }
+
+  void Trace(common::Heap& heap) const
   {
-    std::shared_ptr<Environment> root = top_;
-    while (root->GetParentEnvironment())
+    for (Environment* env: envs_)
     {
-      root = root->GetParentEnvironment();
+      heap.Mark(env);
     }
-    return root;
   }
 
 private:
-  std::shared_ptr<Environment> top_;
+  common::Heap& heap_;
+  std::vector<Environment*> envs_;
 };
 
 } // namespace interpreter
@@ -5,49 +5,98 @@
 namespace interpreter
 {
 
-UserDefinedFunction::UserDefinedFunction(std::shared_ptr<parser::stmt::Func> func,  
-                                         std::shared_ptr<Environment> closure)
-  : func_(func),
+UserDefinedFunction::UserDefinedFunction(Interpreter& interpreter,
+                                         const parser::stmt::Func* func,
+                                         Environment* closure)
+  : interpreter_(interpreter),
+    func_(func),
     closure_(closure)
 {}
 
-common::Object UserDefinedFunction::Call(interpreter::Interpreter& interpreter,
-                                         std::vector<common::Object>& args) const
+common::Object UserDefinedFunction::Call(std::vector<common::Object>& args) const
 {
-  auto g = interpreter.environment_stack_.GetGuard(std::make_shared<Environment>(closure_));
+  FrameStack::Guard frame_g(interpreter_.frames_);
+  Environment* env = interpreter_.NewEnvironment(closure_, func_->kHasClosures);
 
   for (size_t i = 0; i < args.size(); ++i)
   {
-    interpreter.GetCurrentEnv().Define((*(func_->params_))[i]->ToRawString(), args[i]);
+    env->Define(args[i], interpreter_.heap_);
   }
-  
-  interpreter.ExecuteUnguardedBlock(parser::stmt::Block(func_->body_));
 
-  common::Object retval;
-  if (interpreter.retval_)
+  return Run(env);
+}
+
+common::Object UserDefinedFunction::Invoke(const parser::Call& call,
+                                           const common::Object* receiver) const
+{
+  FrameStack::Guard frame_g(interpreter_.frames_);
+
+  Environment* parent = closure_;
+  if (receiver)
+  {
+    // Same layout as Bind() creates.
+    parent = interpreter_.NewEnvironment(closure_, func_->kHasClosures);
+    parent->Define(*receiver, interpreter_.heap_);
+  }
+  Environment* env = interpreter_.NewEnvironment(parent, func_->kHasClosures);
+
+  // Pooled environments are roots already; heap ones are not reachable from
+  // anywhere until the call starts.
+  common::Heap::Root env_root(interpreter_.heap_, env);
+  for (const auto& arg: call.args_)
+  {
+    env->Define(interpreter_.Evaluate(*arg), interpreter_.heap_);
+  }
+  if (call.args_.size() != GetArity())
   {
-    retval = *interpreter.retval_;
-    interpreter.retval_ = nullptr;
+    throw std::runtime_error("Wrong arity");
   }
 
-  return retval;
+  interpreter_.CheckCallDepth(call.paren_);
+  Interpreter::DepthGuard depth(interpreter_.call_depth_);
+  return Run(env);
+}
+
+common::Object UserDefinedFunction::Run(Environment* env) const
+{
+  if (func_->skipped_)
+  {
+    interpreter_.Load(*func_);
+  }
+
+  EnvironmentStack::Guard g(interpreter_.environment_stack_, env);
+
+  interpreter_.ExecuteUnguardedBlock(func_->body_);
+
+  if (interpreter_.completion_ == Interpreter::Completion::RETURN)
+  {
+    interpreter_.completion_ = Interpreter::Completion::NORMAL;
+    return std::move(interpreter_.retval_);
+  }
+
+  return common::MakeNone();
 }
 
 std::string UserDefinedFunction::GetName() const
 {
-  return func_->name_->ToRawString();
+  return func_->name_.ToRawString();
 }
 
 size_t UserDefinedFunction::GetArity() const
 {
-  return func_->params_->size();
+  return func_->params_.size();
+}
+
+common::ICallable* UserDefinedFunction::Bind(common::Object instance) const
+{
+  Environment* wrapper = interpreter_.heap_.Allocate<Environment>(closure_);
+  wrapper->Define(instance, interpreter_.heap_);
+  return interpreter_.heap_.Allocate<UserDefinedFunction>(interpreter_, func_, wrapper);
 }
 
-std::shared_ptr<common::ICallable> UserDefinedFunction::Bind(const std::string& name, common::Object arg) const
+void UserDefinedFunction::Trace(common::Heap& heap) const
 {
-  std::shared_ptr<Environment> wrapper = std::make_shared<Environment>(closure_);
-  wrapper->Define(name, arg);
-  return std::make_shared<UserDefinedFunction>(func_, wrapper);
+  heap.Mark(closure_);
 }
 
 } // namespace interpreter
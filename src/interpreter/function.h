@@ -15,19 +15,33 @@ class UserDefinedFunction: public common::ICallable
 public:
   UserDefinedFunction() = delete;
 
-  UserDefinedFunction(std::shared_ptr<parser::stmt::Func> func, std::shared_ptr<Environment> closure);
+  UserDefinedFunction(Interpreter& interpreter,
+                      const parser::stmt::Func* func,
+                      Environment* closure);
 
-  common::Object Call(interpreter::Interpreter& interpreter, std::vector<common::Object>& args) const override;
+  common::Object Call(std::vector<common::Object>& args) const override;
+
+  // Calls the function with the arguments of call evaluated straight into
+  // its environment. A non-null receiver is bound to "this" for the duration
+  // of the call.
+  common::Object Invoke(const parser::Call& call,
+                        const common::Object* receiver) const;
 
   std::string GetName() const override;
 
   size_t GetArity() const override;
 
-  std::shared_ptr<common::ICallable> Bind(const std::string& name, common::Object arg) const override;
+  common::ICallable* Bind(common::Object instance) const override;
+
+  void Trace(common::Heap& heap) const override;
 
 private:
-  std::shared_ptr<parser::stmt::Func> func_;
-  std::shared_ptr<Environment> closure_;
+  // Runs the body in env, which holds the arguments.
+  common::Object Run(Environment* env) const;
+
+  Interpreter& interpreter_;
+  const parser::stmt::Func* func_;
+  Environment* closure_;
 };
 
 } // namespace interpreter
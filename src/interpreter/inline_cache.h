@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include "common/object.h"
+#include "common/symbol.h"
+#include "class_impl.h"
+#include "instance_impl.h"
+#include "shape.h"
+
+namespace interpreter
+{
+
+// Polymorphic inline cache for one property access site. Entries are keyed by
+// the receiver's shape id; since every class has its own root shape, a shape
+// also identifies the class, and with it the method a name resolves to.
+// Misses take the generic lookup path and fill a free entry, or evict one in
+// round-robin order once the site has seen more than kEntries shapes.
+class InlineCache
+{
+public:
+  static constexpr size_t kEntries = 4;
+
+  common::Object GetProperty(const common::Object& receiver, common::Symbol name)
+  {
+    common::Object field;
+    const common::Object* method = LookupMethod(receiver, name, field);
+    if (method)
+    {
+      return common::MakeCallable(method->AsCallable().Bind(receiver));
+    }
+    return field;
+  }
+
+  // GetProperty() without binding: returns the unbound method, or nullptr
+  // after storing the value of the field in field.
+  const common::Object* LookupMethod(const common::Object& receiver, common::Symbol name, common::Object& field)
+  {
+    InstanceImpl& instance = static_cast<InstanceImpl&>(receiver.AsInstance());
+    const Shape* shape = instance.GetShape();
+
+    const Entry* entry = Find(shape->kId);
+    if (!entry)
+    {
+      Entry fill{shape->kId, shape->Find(name), nullptr, nullptr};
+      if (fill.slot == Shape::kNotFound)
+      {
+        fill.method = instance.GetClass().FindMethod(name);
+        if (!fill.method)
+        {
+          // Throws the "no property" error.
+          instance.Get(name);
+        }
+      }
+      entry = &Insert(std::move(fill));
+    }
+
+    if (entry->method)
+    {
+      return entry->method;
+    }
+    field = instance.GetField(entry->slot);
+    return nullptr;
+  }
+
+  // New fields are accounted to heap.
+  void SetProperty(const common::Object& receiver, common::Symbol name, common::Object value, common::Heap& heap)
+  {
+    InstanceImpl& instance = static_cast<InstanceImpl&>(receiver.AsInstance());
+    Shape* shape = instance.GetShape();
+
+    const Entry* entry = Find(shape->kId);
+    if (!entry)
+    {
+      Entry fill{shape->kId, shape->Find(name), nullptr, nullptr};
+      if (fill.slot == Shape::kNotFound)
+      {
+        fill.slot = shape->Size();
+        fill.transition = shape->AddField(name);
+      }
+      entry = &Insert(std::move(fill));
+    }
+
+    if (entry->transition)
+    {
+      instance.AddField(entry->transition, std::move(value), heap);
+    }
+    else
+    {
+      instance.GetField(entry->slot) = std::move(value);
+    }
+  }
+
+  // Method of super_class bound to this_instance, as in "super.name".
+  common::Object GetSuperMethod(const common::Object& super_class,
+                                const common::Object& this_instance,
+                                common::Symbol name)
+  {
+    const ClassImpl& klass = static_cast<const ClassImpl&>(super_class.AsClass());
+    uint64_t key = klass.GetRootShape().kId;
+
+    const Entry* entry = Find(key);
+    if (!entry)
+    {
+      auto method = klass.FindMethod(name);
+      if (!method)
+      {
+        throw std::runtime_error("Method \"" + common::GetSymbolName(name) + "\" not found.");
+      }
+      entry = &Insert({key, Shape::kNotFound, nullptr, method});
+    }
+
+    return common::MakeCallable(entry->method->AsCallable().Bind(this_instance));
+  }
+
+private:
+  struct Entry
+  {
+    uint64_t shape_id;
+    // Field slot; for a store that adds the field, the slot it is added at.
+    size_t slot;
+    // Shape after a store that adds the field, nullptr otherwise.
+    Shape* transition;
+    // Resolved method when the name is not a field. Owned by the class, which
+    // is alive whenever an instance of the shape is.
+    const common::Object* method;
+  };
+
+  Entry entries_[kEntries];
+  uint8_t size_ = 0;
+  uint8_t next_evict_ = 0;
+
+  const Entry* Find(uint64_t shape_id) const
+  {
+    for (uint8_t i = 0; i < size_; ++i)
+    {
+      if (entries_[i].shape_id == shape_id)
+      {
+        return &entries_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  const Entry& Insert(Entry entry)
+  {
+    if (size_ < kEntries)
+    {
+      return entries_[size_++] = std::move(entry);
+    }
+    Entry& victim = entries_[next_evict_];
+    next_evict_ = (next_evict_ + 1) % kEntries;
+    return victim = std::move(entry);
+  }
+};
+
+} // namespace interpreter
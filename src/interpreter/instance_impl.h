@@ -1,19 +1,27 @@
 #pragma once
 
-#include <unordered_map>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "common/class.h"
+#include "common/heap.h"
 #include "common/instance.h"
+#include "shape.h"
 
 namespace interpreter
 {
-  
-class InstanceImpl: public common::IInstance, public std::enable_shared_from_this<InstanceImpl>
+
+// Fields live in a flat array laid out by shape_. Methods are not stored on
+// the instance; they are bound on every access.
+class InstanceImpl: public common::IInstance
 {
 public:
-  InstanceImpl(std::shared_ptr<common::IClass> class_type)
-    : class_type_(class_type)
+  // fields holds a value for each field of shape.
+  InstanceImpl(const common::IClass* class_type, Shape* shape, std::vector<common::Object> fields)
+    : class_type_(class_type),
+      shape_(shape),
+      fields_(std::move(fields))
   {}
 
   std::string GetTypeName() const override
@@ -21,40 +29,77 @@ public:
     return class_type_->GetName();
   }
 
-  common::Object& Get(const std::string& name, bool create_if_not_exist) override
+  common::Object Get(common::Symbol name) override
   {
-    if (create_if_not_exist)
+    size_t slot = shape_->Find(name);
+    if (slot != Shape::kNotFound)
     {
-      return properties_[name];
+      return fields_[slot];
     }
 
-    auto propit = properties_.find(name);
-    if (propit != properties_.end())
+    auto method = class_type_->FindMethod(name);
+    if (method)
     {
-      return propit->second;
+      return common::MakeCallable(method->AsCallable().Bind(common::MakeInstance(this)));
     }
+    
+    throw std::runtime_error(GetTypeName() + " has no " + common::GetSymbolName(name) + " property.");
+  }
 
-    auto methit = methods_.find(name);
-    if (methit != methods_.end())
+  // Without a heap to account to, a new field is only counted by the next
+  // collection; engines set properties through InlineCache::SetProperty().
+  void Set(common::Symbol name, common::Object value) override
+  {
+    size_t slot = shape_->Find(name);
+    if (slot != Shape::kNotFound)
     {
-      return methit->second;
+      fields_[slot] = std::move(value);
+      return;
     }
 
-    auto method = class_type_->FindMethod(name);
-    if (method)
+    shape_ = shape_->AddField(name);
+    fields_.push_back(std::move(value));
+  }
+
+  const common::IClass& GetClass() const { return *class_type_; }
+
+  Shape* GetShape() const { return shape_; }
+
+  common::Object& GetField(size_t slot) { return fields_[slot]; }
+
+  // shape must be the transition of shape_ by one field. Growing the fields
+  // is accounted to heap.
+  void AddField(Shape* shape, common::Object value, common::Heap& heap)
+  {
+    shape_ = shape;
+    size_t capacity = fields_.capacity();
+    fields_.push_back(std::move(value));
+    if (fields_.capacity() != capacity)
     {
-      auto callable_ptr = method->AsCallable().Bind("this", common::MakeInstance(shared_from_this()));
-      common::Object obj = common::MakeCallable(callable_ptr);
-      return methods_[name] = obj;
+      heap.Grow((fields_.capacity() - capacity) * sizeof(common::Object));
+    }
+  }
+
+  size_t GetPayloadSize() const override
+  {
+    return fields_.capacity() * sizeof(common::Object);
+  }
+
+  void Trace(common::Heap& heap) const override
+  {
+    heap.Mark(class_type_);
+    for (const common::Object& obj: fields_)
+    {
+      heap.Mark(obj);
     }
-    
-    throw std::runtime_error(GetTypeName() + " has no " + name + " property.");
   }
 
 private:
-  std::shared_ptr<common::IClass> class_type_;
-  std::unordered_map<std::string, common::Object> properties_;
-  std::unordered_map<std::string, common::Object> methods_;
+  // Keeps the shape tree alive.
+  const common::IClass* class_type_;
+  // Owned by the shape tree of class_type_.
+  Shape* shape_;
+  std::vector<common::Object> fields_;
 };
 
 } // namespace interpreter
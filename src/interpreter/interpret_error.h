@@ -1,8 +1,10 @@
 #pragma once
 
 #include <stdexcept>
+#include <string>
 
 #include "scanner/token.h"
+#include "util/source_file.h"
 
 namespace interpreter
 {
@@ -23,8 +25,17 @@ public:
     return message_.c_str();
   }
 
+  const scanner::Token& GetToken() const { return token_; }
+
+  // The message prefixed with the position of the token in file.
+  std::string Format(const util::SourceFile& file) const
+  {
+    auto pos = token_.GetPosition(file);
+    return "[RUNTIME]:" + std::to_string(pos.first) + ":" + std::to_string(pos.second) + ": " + message_;
+  }
+
 private:
-  const scanner::Token& token_;
+  const scanner::Token token_;
   std::string message_;
 };
 
@@ -1,12 +1,19 @@
 #pragma once
 
+#include <iostream>
+#include <ostream>
 #include <unordered_map>
+#include <vector>
 
 #include "common/callable.h"
+#include "common/heap.h"
 #include "common/object.h"
 
 #include "scanner/token.h"
 #include "parser/expr.h"
+#include "resolver/module_loader.h"
+#include "resolver/resolution.h"
+#include "util/source_file.h"
 #include "util/visitor_getter.h"
 
 #include "builtin/functions.h"
@@ -15,6 +22,9 @@
 #include "class_impl.h"
 #include "interpret_error.h"
 #include "environment.h"
+#include "inline_cache.h"
+#include "module_table.h"
+#include "operators.h"
 
 
 
@@ -26,13 +36,26 @@ class Interpreter: public util::VisitorGetter<Interpreter, parser::Expr, common:
                    public parser::stmt::IStmtVisitor
 {
 public:
-  Interpreter()
-  {
-    GetCurrentEnv().Define("clock", common::MakeCallable(std::make_shared<builtin::functions::ClockBuiltin>()));
-    GetCurrentEnv().Define("print", common::MakeCallable(std::make_shared<builtin::functions::PrintBuiltin>()));
-  }
-
-  void Interpret(const std::vector<std::shared_ptr<parser::stmt::Stmt>>& statements)
+  // loader provides the imported modules and completes functions that a
+  // lazy parse skipped. The script prints to out; runtime errors go to err.
+  Interpreter(const util::SourceFile& file,
+              const resolver::Resolution& resolution,
+              resolver::IModuleLoader* loader = nullptr,
+              std::ostream& out = std::cout,
+              std::ostream& err = std::cerr)
+    : kFile(file),
+      resolution_(resolution),
+      loader_(loader),
+      out_(out),
+      err_(err),
+      heap_([this](common::Heap& heap) { TraceRoots(heap); }),
+      environment_stack_(heap_),
+      caches_(resolution.GetNumIds())
+  {
+    DefineBuiltins(GetCurrentEnv());
+  }
+
+  void Interpret(util::Span<parser::stmt::Stmt*> statements)
   {
     try
     {
@@ -43,32 +66,45 @@ public:
     }
     catch (const InterpretError& e)
     {
-      std::cerr << e.what() << '\n';
+      err_ << e.Format(GetFile(e.GetToken())) << '\n';
     }
     
   }
 
-  void Execute(const parser::stmt::Stmt& stmt)
+  // RETURN means a return statement was executed and the enclosing function
+  // call has to unwind; the value is in retval_.
+  enum class Completion
+  {
+    NORMAL,
+    RETURN
+  };
+
+  Completion Execute(const parser::stmt::Stmt& stmt)
   {
+    // Every value that is still needed is reachable from the environments or
+    // from a Root guard of an enclosing expression.
+    heap_.Safepoint();
     stmt.Accept(*this);
+    return completion_;
   }
 
   void Visit(const parser::stmt::Return& stmt)
   {
     if (stmt.value_)
     {
-      retval_ = std::make_shared<common::Object>(Evaluate(*stmt.value_));
+      retval_ = Evaluate(*stmt.value_);
     }
     else
     {
-      retval_ = std::make_shared<common::Object>(common::MakeNone());
+      retval_ = common::MakeNone();
     }
+    completion_ = Completion::RETURN;
   }
 
   void Visit(const parser::stmt::If& stmt)
   {
     common::Object obj = Evaluate(*stmt.condition_);
-    if (IsTruthy(obj))
+    if (operators::IsTruthy(obj))
     {
       Execute(*stmt.stmt_true_);
     }
@@ -85,9 +121,10 @@ public:
 
   void Visit(const parser::stmt::Func& stmt)
   {
-    auto fn = std::make_shared<UserDefinedFunction>(std::make_shared<parser::stmt::Func>(stmt),
-                                                    environment_stack_.GetCurrent());
-    GetCurrentEnv().Define(stmt.name_->ToRawString(), common::MakeCallable(fn));
+    auto fn = heap_.Allocate<UserDefinedFunction>(*this,
+                                                  &stmt,
+                                                  environment_stack_.GetCurrent());
+    GetCurrentEnv().Define(common::MakeCallable(fn), heap_);
   }
 
   void Visit(const parser::stmt::Class& stmt)
@@ -99,24 +136,23 @@ public:
       super.AssumeType(common::Object::CLASS);
     }
 
-    GetCurrentEnv().Define(stmt.name_->ToRawString(), common::MakeNone());
+    size_t slot = GetCurrentEnv().Define(common::MakeNone(), heap_);
 
     std::unique_ptr<EnvironmentStack::Guard> super_g;
     if (stmt.super_)
     {
       super_g = GetEnvGuard();
-      GetCurrentEnv().Define("super", super);
+      GetCurrentEnv().Define(super, heap_);
     }
 
-    std::unordered_map<std::string, std::shared_ptr<common::Object>> methods;
-    for (auto m: *stmt.methods_)
+    ClassImpl::Methods methods;
+    for (auto m: stmt.methods_)
     {
-      auto fn = std::make_shared<UserDefinedFunction>(m, environment_stack_.GetCurrent());
-      methods[m->name_->ToRawString()] = std::make_shared<common::Object>(common::MakeCallable(fn));
+      auto fn = heap_.Allocate<UserDefinedFunction>(*this, m, environment_stack_.GetCurrent());
+      methods[m->name_.GetSymbol()] = common::MakeCallable(fn);
     }
 
-    auto ptr = std::make_shared<ClassImpl>(stmt.name_->ToRawString(), super, methods);
-    ptr->SetSelf(ptr);
+    auto ptr = heap_.Allocate<ClassImpl>(heap_, stmt.name_.ToRawString(), super, methods);
     common::Object obj = common::MakeClass(ptr);
 
     if (stmt.super_)
@@ -124,7 +160,7 @@ public:
       delete super_g.release();
     }
 
-    GetCurrentEnv().GetAt(stmt.name_->ToRawString(), 0) = obj;
+    GetCurrentEnv().GetAt(0, slot) = obj;
   }
 
   void Visit(const parser::stmt::Expression& stmt)
@@ -135,14 +171,17 @@ public:
   void Visit(const parser::stmt::Print& stmt)
   {
     common::Object obj = Evaluate(*stmt.expr_);
-    std::cout << obj.ToString() << "\n";
+    out_ << obj.ToString() << "\n";
   }
 
   void Visit(const parser::stmt::While& stmt)
   {
-    while (IsTruthy(Evaluate(*stmt.condition_)))
+    while (operators::IsTruthy(Evaluate(*stmt.condition_)))
     {
-      Execute(*stmt.body_);
+      if (Execute(*stmt.body_) == Completion::RETURN)
+      {
+        return;
+      }
     }
   }
 
@@ -154,39 +193,38 @@ public:
       init = Evaluate(*stmt.expr_);
     }
 
-    GetCurrentEnv().Define(stmt.name_->ToRawString(), init);
+    GetCurrentEnv().Define(init, heap_);
+  }
+
+  void Visit(const parser::stmt::Import& stmt)
+  {
+    GetCurrentEnv().Define(Import(stmt), heap_);
   }
 
   void Visit(const parser::This& expr) override
   {
-    common::Object& obj = LookupVariable(expr, *expr.name_);
+    common::Object& obj = LookupVariable(expr, expr.name_);
     Return(obj);
   }
 
   void Visit(const parser::Super& expr) override
   {
-    auto it = resolve_.find(expr.kId);
-    if (it == resolve_.end())
+    const resolver::Location* location = resolution_.Find(expr.kId);
+    if (!location)
     {
       throw std::runtime_error("Unresolved identifier \"super\"");
     }
-    size_t depth = it->second;
+    size_t depth = location->depth;
     if (!depth)
     {
       throw std::logic_error("Depth == 0");
     }
 
-    common::Object& super = GetCurrentEnv().GetAt("super", depth);
-    common::Object& this_instance = GetCurrentEnv().GetAt("this", depth - 1);
-
-    auto p = super.AsClass().FindMethod(expr.method_->ToRawString());
-    if (!p)
-    {
-      throw std::runtime_error("Method \"" + expr.method_->ToRawString() + "\" not found.");
-    }
-    auto bind = p->AsCallable().Bind("this", this_instance);
+    // "super" and "this" are the only variables of their environments.
+    common::Object& super = GetCurrentEnv().GetAt(depth, 0);
+    common::Object& this_instance = GetCurrentEnv().GetAt(depth - 1, 0);
 
-    Return(common::MakeCallable(bind));
+    Return(caches_[expr.kId].GetSuperMethod(super, this_instance, expr.method_.GetSymbol()));
   }
 
   void Visit(const parser::Get& expr) override
@@ -195,7 +233,7 @@ public:
 
     if (obj.GetType() == common::Object::INSTANCE)
     {
-      Return(obj.AsInstance().Get(expr.name_->ToRawString(), false));
+      Return(caches_[expr.kId].GetProperty(obj, expr.name_.GetSymbol()));
       return;
     }
 
@@ -208,8 +246,9 @@ public:
 
     if (obj.GetType() == common::Object::INSTANCE)
     {
+      common::Heap::Root obj_root(heap_, obj);
       common::Object value = Evaluate(*expr.value_);
-      obj.AsInstance().Get(expr.name_->ToRawString(), true) = value;
+      caches_[expr.kId].SetProperty(obj, expr.name_.GetSymbol(), value, heap_);
       Return(value);
       return;
     }
@@ -221,7 +260,7 @@ public:
   {
     common::Object obj = Evaluate(*expr.value_);
 
-    LookupVariable(expr, *expr.name_) = obj;
+    LookupVariable(expr, expr.name_) = obj;
 
     Return(obj);
   }
@@ -241,7 +280,7 @@ public:
   {
     common::Object obj = Evaluate(*expr.right_);
 
-    switch (expr.op_->GetType())
+    switch (expr.op_.GetType())
     {
       case (scanner::Token::MINUS):
       {
@@ -254,12 +293,12 @@ public:
             Return(common::MakeFloat(-obj.AsFloat()));
             return;
           default:
-            throw InterpretError(*expr.op_, "Int or Float expected before " + expr.op_->ToString());
+            throw InterpretError(expr.op_, "Int or Float expected before " + expr.op_.ToString());
         }
       }
       case (scanner::Token::BANG):
       {
-        Return(common::MakeBool(!IsTruthy(obj)));
+        Return(common::MakeBool(!operators::IsTruthy(obj)));
         return;
       }
       default:
@@ -269,13 +308,18 @@ public:
 
   void Visit(const parser::Logical& expr) override
   {
-    common::Object left = Evaluate(*expr.left_);
-
-    if (expr.op_->GetType() == scanner::Token::OR && IsTruthy(left))
+    if (operator_depth_ == kMaxOperatorDepth)
     {
-      Return(left);
+      Return(EvaluateChain(expr));
+      return;
     }
-    else if (!IsTruthy(left))
+    DepthGuard depth(operator_depth_);
+
+    common::Object left = Evaluate(*expr.left_);
+
+    // "or" stops at the first truthy operand, "and" at the first falsy one.
+    bool is_or = expr.op_.GetType() == scanner::Token::OR;
+    if (operators::IsTruthy(left) == is_or)
     {
       Return(left);
     }
@@ -285,106 +329,188 @@ public:
     }
   }
 
+  // Short chains of operators are evaluated by recursion, which is the
+  // fastest, and long ones like "a + b + c + ..." from a generator in a loop,
+  // which does not overflow the stack.
   void Visit(const parser::Binary& expr) override
   {
-    common::Object left = Evaluate(*expr.left_);
-    common::Object right = Evaluate(*expr.right_);
-    scanner::Token::Type op_type = expr.op_->GetType();
-
-    if (expr.op_->GetType() == scanner::Token::EQUAL_EQUAL)
-    {
-      Return(common::MakeBool(left.IsEqual(right)));
-      return;
-    }
-    if (expr.op_->GetType() == scanner::Token::BANG_EQUAL)
+    if (operator_depth_ == kMaxOperatorDepth)
     {
-      Return(common::MakeBool(!left.IsEqual(right)));
+      Return(EvaluateChain(expr));
       return;
     }
+    DepthGuard depth(operator_depth_);
 
+    common::Object left = Evaluate(*expr.left_);
+    common::Heap::Root left_root(heap_, left);
+    common::Object right = Evaluate(*expr.right_);
+    Return(ApplyBinary(expr, left, right));
+  }
+
+  // Evaluates a chain of Binary and Logical operators, see
+  // parser::CollectLeftChain(), from its leftmost operand up in a loop.
+  common::Object EvaluateChain(const parser::Expr& expr)
+  {
+    // The entries above base are this chain's. A runtime error leaves them
+    // behind, which is harmless as every chain only pops its own.
+    size_t base = chain_.size();
+    common::Object value = Evaluate(*parser::CollectLeftChain(expr, chain_));
+    common::Heap::Root value_root(heap_, value);
+    while (chain_.size() > base)
     {
-      bool left_str = left.GetType() == common::Object::STRING;
-      bool right_str = right.GetType() == common::Object::STRING;
-      if (left_str || right_str)
+      const parser::Expr* link = chain_.back();
+      chain_.pop_back();
+      if (auto logical = dynamic_cast<const parser::Logical*>(link))
       {
-        if (op_type == scanner::Token::PLUS)
+        bool is_or = logical->op_.GetType() == scanner::Token::OR;
+        if (operators::IsTruthy(value) != is_or)
         {
-          Return(common::MakeString(left.ToString() + right.ToString()));
-          return;
+          value = Evaluate(*logical->right_);
         }
-        throw InterpretError(*expr.op_, left.GetTypeName() + " and " + right.GetTypeName() + " are not valid for +.");
+      }
+      else
+      {
+        const auto& binary = static_cast<const parser::Binary&>(*link);
+        common::Object right = Evaluate(*binary.right_);
+        value = ApplyBinary(binary, value, right);
       }
     }
+    return value;
+  }
 
-    std::vector<scanner::Token::Type> arithmetic_op_types = {scanner::Token::MINUS,
-                                                             scanner::Token::PLUS,
-                                                             scanner::Token::STAR,
-                                                             scanner::Token::SLASH};
+  common::Object ApplyBinary(const parser::Binary& expr, common::Object& left, common::Object& right)
+  {
+    switch (expr.kOp)
+    {
+      case parser::BinaryOp::EQUAL:
+        return common::MakeBool(left.IsEqual(right));
+      case parser::BinaryOp::NOT_EQUAL:
+        return common::MakeBool(!left.IsEqual(right));
+      case parser::BinaryOp::GREATER:
+        return EvaluateArithmetic<parser::BinaryOp::GREATER>(expr, left, right);
+      case parser::BinaryOp::GREATER_EQUAL:
+        return EvaluateArithmetic<parser::BinaryOp::GREATER_EQUAL>(expr, left, right);
+      case parser::BinaryOp::LESS:
+        return EvaluateArithmetic<parser::BinaryOp::LESS>(expr, left, right);
+      case parser::BinaryOp::LESS_EQUAL:
+        return EvaluateArithmetic<parser::BinaryOp::LESS_EQUAL>(expr, left, right);
+      case parser::BinaryOp::ADD:
+        return EvaluateArithmetic<parser::BinaryOp::ADD>(expr, left, right);
+      case parser::BinaryOp::SUBTRACT:
+        return EvaluateArithmetic<parser::BinaryOp::SUBTRACT>(expr, left, right);
+      case parser::BinaryOp::MULTIPLY:
+        return EvaluateArithmetic<parser::BinaryOp::MULTIPLY>(expr, left, right);
+      case parser::BinaryOp::DIVIDE:
+        return EvaluateArithmetic<parser::BinaryOp::DIVIDE>(expr, left, right);
+    }
+    throw std::logic_error("Bad binary type.");
+  }
+
+  void Visit(const parser::Variable& expr) override
+  {
+    Return(LookupVariable(expr, expr.name_));
+  }
+
+  void Visit(const parser::Call& expr) override
+  {
+    if (expr.kMethod)
+    {
+      CallMethod(expr, *expr.kMethod);
+      return;
+    }
 
-    std::vector<scanner::Token::Type> comparison_op_types = {scanner::Token::GREATER,
-                                                             scanner::Token::GREATER_EQUAL,
-                                                             scanner::Token::LESS,
-                                                             scanner::Token::LESS_EQUAL};
+    common::Object callee = Evaluate(*expr.callee_);
+    CallValue(expr, callee);
+  }
 
-    std::vector<scanner::Token::Type> equality_op_types = {scanner::Token::EQUAL_EQUAL,
-                                                           scanner::Token::BANG_EQUAL};
+private:
+  friend class UserDefinedFunction;
 
-    if (!expr.op_->OneOf(arithmetic_op_types) &&
-        !expr.op_->OneOf(comparison_op_types))
+  const util::SourceFile& kFile;
+  const resolver::Resolution& resolution_;
+  resolver::IModuleLoader* loader_;
+  std::ostream& out_;
+  std::ostream& err_;
+  common::Heap heap_;
+  EnvironmentStack environment_stack_;
+  FrameStack frames_;
+  ModuleTable modules_;
+  Completion completion_ = Completion::NORMAL;
+  common::Object retval_;
+  // Property access caches of Get, Set and Super sites, indexed by Expr::kId.
+  std::vector<InlineCache> caches_;
+  // Binary and Logical nodes being evaluated by recursion. Past
+  // kMaxOperatorDepth the rest of a chain is evaluated by EvaluateChain().
+  static constexpr size_t kMaxOperatorDepth = 256;
+  size_t operator_depth_ = 0;
+  // Calls entered, limited like the frames of the VM so that deep recursion
+  // fails as a runtime error before it overflows the stack.
+  static constexpr size_t kMaxCallDepth = 1 << 12;
+  size_t call_depth_ = 0;
+  // Links of the operator chains being evaluated, see EvaluateChain().
+  std::vector<const parser::Expr*> chain_;
+
+  class DepthGuard
+  {
+  public:
+    DepthGuard(size_t& depth)
+      : depth_(depth)
     {
-      throw InterpretError(*expr.op_, "Expected arithmetic or comparison operator.");
+      ++depth_;
     }
 
-    if (!left.IsNumber() || !right.IsNumber())
+    ~DepthGuard()
     {
-      throw InterpretError(*expr.op_, left.GetTypeName() + " and " +
-                           right.GetTypeName() + " are not valid for " +
-                           expr.op_->ToRawString());
+      --depth_;
     }
 
-    if (left.GetType() == common::Object::FLOAT || right.GetType() == common::Object::FLOAT)
+  private:
+    size_t& depth_;
+  };
+
+  // "object.name(...)": a method found on the object is called with "this"
+  // bound in the call frame, without creating a bound method.
+  void CallMethod(const parser::Call& expr, const parser::Get& get)
+  {
+    common::Object receiver = Evaluate(*get.object_);
+    if (receiver.GetType() != common::Object::INSTANCE)
     {
-      double l = AsNumber<double>(left);
-      double r = AsNumber<double>(right);
+      throw std::runtime_error("Expected <instance> before \".\"");
+    }
+    common::Heap::Root receiver_root(heap_, receiver);
 
-      if (expr.op_->OneOf(arithmetic_op_types))
-      {
-        Return(common::MakeFloat(DispatchBinary(l, op_type, r)));
-      }
-      else
-      {
-        Return(common::MakeBool(DispatchBinary<double, bool>(l, op_type, r)));
-      }
+    common::Object field;
+    const common::Object* method = caches_[get.kId].LookupMethod(receiver, get.name_.GetSymbol(), field);
+    if (!method)
+    {
+      CallValue(expr, field);
       return;
     }
-    else
-    {
-      int64_t l = AsNumber<int64_t>(left);
-      int64_t r = AsNumber<int64_t>(right);
 
-      if (expr.op_->OneOf(arithmetic_op_types))
-      {
-        Return(common::MakeInt(DispatchBinary(l, op_type, r)));
-      }
-      else
-      {
-        Return(common::MakeBool(DispatchBinary<int64_t, bool>(l, op_type, r)));
-      }
+    if (auto fn = dynamic_cast<const UserDefinedFunction*>(&method->AsCallable()))
+    {
+      Return(fn->Invoke(expr, &receiver));
       return;
     }
+    CallValue(expr, common::MakeCallable(method->AsCallable().Bind(receiver)));
   }
 
-  void Visit(const parser::Variable& expr) override
+  void CallValue(const parser::Call& expr, common::Object callee)
   {
-    Return(LookupVariable(expr, *expr.name_));
-  }
+    common::Heap::Root callee_root(heap_, callee);
 
-  void Visit(const parser::Call& expr) override
-  {
-    common::Object callee = Evaluate(*expr.callee_);
+    if (callee.GetType() == common::Object::CALLABLE)
+    {
+      if (auto fn = dynamic_cast<const UserDefinedFunction*>(&callee.AsCallable()))
+      {
+        Return(fn->Invoke(expr, nullptr));
+        return;
+      }
+    }
 
     std::vector<common::Object> args;
-    for (const auto& arg: *expr.args_)
+    common::Heap::Root args_root(heap_, args);
+    for (const auto& arg: expr.args_)
     {
       args.push_back(Evaluate(*arg));
     }
@@ -394,26 +520,74 @@ public:
     {
       throw std::runtime_error("Wrong arity");
     }
-    Return(func.Call(*this, args));
+    CheckCallDepth(expr.paren_);
+    DepthGuard depth(call_depth_);
+    Return(func.Call(args));
   }
 
-  void Resolve(const parser::Expr& expr, size_t depth)
+  // Throws at paren if entering another call would exceed kMaxCallDepth.
+  // Calls whose arguments are still being evaluated do not count, as in the
+  // VM, which pushes a frame once they are.
+  void CheckCallDepth(const scanner::Token& paren) const
   {
-    size_t id = expr.kId;
-    if (id == (size_t)-1)
+    if (call_depth_ == kMaxCallDepth)
     {
-      throw std::logic_error("id == -1");
+      throw InterpretError(paren, "Stack overflow.");
     }
-    resolve_[id] = depth;
   }
 
+  void TraceRoots(common::Heap& heap)
+  {
+    environment_stack_.Trace(heap);
+    frames_.Trace(heap);
+    modules_.Trace(heap);
+    heap.Mark(retval_);
+  }
 
-private:
-  friend class UserDefinedFunction;
+  void DefineBuiltins(Environment& globals)
+  {
+    // Keep in sync with the global slots declared by resolver::Resolver.
+    globals.Define(common::MakeCallable(heap_.Allocate<builtin::functions::ClockBuiltin>()), heap_);
+    globals.Define(common::MakeCallable(heap_.Allocate<builtin::functions::PrintBuiltin>(out_)), heap_);
+  }
 
-  EnvironmentStack environment_stack_;
-  std::shared_ptr<common::Object> retval_;
-  std::unordered_map<size_t, size_t> resolve_;
+  // The object of the imported module, which runs first if this is its
+  // first import.
+  common::Object Import(const parser::stmt::Import& stmt)
+  {
+    size_t module = stmt.module_;
+    switch (modules_.GetState(module))
+    {
+      case ModuleTable::State::DONE:
+        return modules_.Get(module);
+      case ModuleTable::State::RUNNING:
+        throw InterpretError(stmt.name_, "Circular import of \"" + stmt.name_.ToRawString() + "\".");
+      case ModuleTable::State::NOT_RUN:
+        break;
+    }
+    if (!loader_)
+    {
+      throw InterpretError(stmt.name_, "Can not import \"" + stmt.name_.ToRawString() + "\".");
+    }
+    modules_.SetRunning(module);
+
+    // Modules have globals of their own, which their functions capture.
+    Environment* globals = heap_.Allocate<Environment>();
+    EnvironmentStack::Guard g(environment_stack_, globals);
+    DefineBuiltins(*globals);
+    for (const auto& s: loader_->GetStatements(module))
+    {
+      Execute(*s);
+    }
+    return modules_.Finish(heap_, module, stmt.name_, *globals, loader_->GetExports(module));
+  }
+
+  // The source file the token is from.
+  const util::SourceFile& GetFile(const scanner::Token& token) const
+  {
+    const util::SourceFile* file = loader_ ? loader_->FindFile(token.GetLexeme().data()) : nullptr;
+    return file ? *file : kFile;
+  }
 
   Environment& GetCurrentEnv()
   {
@@ -425,33 +599,52 @@ private:
     return environment_stack_.GetGuard();
   }
 
+  // Environments of scopes without closures come from frames_.
+  Environment* NewEnvironment(Environment* parent_env, bool has_closures)
+  {
+    if (has_closures)
+    {
+      return heap_.Allocate<Environment>(parent_env);
+    }
+    return frames_.Push(parent_env);
+  }
+
   void ExecuteBlock(const parser::stmt::Block& stmt)
   {
-    auto g = GetEnvGuard();
+    FrameStack::Guard frame_g(frames_);
+    EnvironmentStack::Guard g(environment_stack_,
+                              NewEnvironment(environment_stack_.GetCurrent(), stmt.kHasClosures));
 
-    ExecuteUnguardedBlock(stmt);
+    ExecuteUnguardedBlock(stmt.statements_);
   }
 
-  void ExecuteUnguardedBlock(const parser::stmt::Block& stmt)
+  void ExecuteUnguardedBlock(util::Span<parser::stmt::Stmt*> statements)
   {
-    for (const auto& s: *stmt.statements_)
+    for (const auto& s: statements)
     {
-      if (retval_)
+      if (Execute(*s) == Completion::RETURN)
       {
         return;
       }
-      Execute(*s);
+    }
+  }
+
+  void Load(const parser::stmt::Func& func)
+  {
+    if (!loader_ || !loader_->Load(func))
+    {
+      throw InterpretError(func.name_, "Can not load function \"" + func.name_.ToRawString() + "\".");
     }
   }
 
   common::Object& LookupVariable(const parser::Expr& expr, const scanner::Token& name)
   {
-    auto it = resolve_.find(expr.kId);
-    if (it == resolve_.end())
+    const resolver::Location* location = resolution_.Find(expr.kId);
+    if (!location)
     {
       throw std::runtime_error("Unresolved identifier \"" + name.ToRawString() + "\"");
     }
-    return GetCurrentEnv().GetAt(name.ToRawString(), it->second);
+    return GetCurrentEnv().GetAt(location->depth, location->slot);
   }
 
   common::Object Evaluate(const parser::Expr& expr)
@@ -459,75 +652,34 @@ private:
     return GetValue(expr);
   }
 
-  bool IsTruthy(const common::Object& obj)
+  template <parser::BinaryOp Op>
+  common::Object EvaluateArithmetic(const parser::Binary& expr, common::Object& left, common::Object& right)
   {
-    switch (obj.GetType())
+    common::Object result;
+    if (operators::ApplyNumeric<Op>(left, right, result))
     {
-      case (common::Object::NONE):
-        return false;
-      case (common::Object::BOOLEAN):
-        return obj.AsBool();
-      default:
-        return true;
+      return result;
+    }
+    if (Op == parser::BinaryOp::DIVIDE && left.GetType() == common::Object::INT &&
+        right.GetType() == common::Object::INT)
+    {
+      throw InterpretError(expr.op_, operators::GetDivisionError(right.AsInt()));
     }
-  }
 
-  template <typename T, typename U = T>
-  T DispatchBinary(T l, scanner::Token::Type op_type, T r)
-  {
-    switch (op_type)
+    bool left_str = left.GetType() == common::Object::STRING;
+    bool right_str = right.GetType() == common::Object::STRING;
+    if (left_str || right_str)
     {
-      // comparison
-      case (scanner::Token::GREATER_EQUAL):
+      if (Op == parser::BinaryOp::ADD)
       {
-        return l >= r;
+        return heap_.MakeString(left.ToString() + right.ToString());
       }
-      case (scanner::Token::GREATER):
-      {
-        return l > r;
-      }
-      case (scanner::Token::LESS_EQUAL):
-      {
-        return l <= r;
-      }
-      case (scanner::Token::LESS):
-      {
-        return l < r;
-      }
-      // Arithmetics
-      case (scanner::Token::MINUS):
-      {
-        return l - r;
-      }
-      case (scanner::Token::SLASH):
-      {
-        return l / r;
-      }
-      case (scanner::Token::STAR):
-      {
-        return l * r;
-      }
-      case (scanner::Token::PLUS):
-      {
-        return l + r;
-      }
-      default:
-        throw std::logic_error("DispatchBinary called with bad op_type");
+      throw InterpretError(expr.op_, left.GetTypeName() + " and " + right.GetTypeName() + " are not valid for +.");
     }
-  }
 
-  template <typename T>
-  T AsNumber(const common::Object& obj)
-  {
-    if (obj.GetType() == common::Object::INT)
-    {
-      return obj.AsInt();
-    }
-    if (obj.GetType() == common::Object::FLOAT)
-    {
-      return obj.AsFloat();
-    }
-    throw std::logic_error("Not a number");
+    throw InterpretError(expr.op_, left.GetTypeName() + " and " +
+                         right.GetTypeName() + " are not valid for " +
+                         expr.op_.ToRawString());
   }
 };
 
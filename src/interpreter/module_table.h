@@ -0,0 +1,100 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/heap.h"
+#include "common/object.h"
+#include "resolver/module_loader.h"
+#include "scanner/token.h"
+#include "class_impl.h"
+#include "environment.h"
+
+namespace interpreter
+{
+
+// Module objects of a running program, by module index. A module runs on its
+// first import and every later import gets the same object: an instance
+// with a field per global of the module, as they were when it finished.
+class ModuleTable
+{
+public:
+  enum class State
+  {
+    NOT_RUN,
+    RUNNING,
+    DONE
+  };
+
+  ModuleTable()
+    // The main script is running from the start.
+    : states_{State::RUNNING},
+      objects_{common::MakeNone()}
+  {}
+
+  State GetState(size_t module) const
+  {
+    return module < states_.size() ? states_[module] : State::NOT_RUN;
+  }
+
+  void SetRunning(size_t module)
+  {
+    if (module >= states_.size())
+    {
+      states_.resize(module + 1, State::NOT_RUN);
+      objects_.resize(module + 1, common::MakeNone());
+    }
+    states_[module] = State::RUNNING;
+  }
+
+  // Only for DONE modules.
+  common::Object Get(size_t module) const
+  {
+    return objects_[module];
+  }
+
+  // Makes the object of module, whose top-level code has run in globals.
+  common::Object Finish(common::Heap& heap,
+                        size_t module,
+                        const scanner::Token& name,
+                        Environment& globals,
+                        const std::vector<resolver::Export>& exports)
+  {
+    // The fields are laid out in one shape rather than added one by one,
+    // which would make a shape per prefix of a long list. Nothing here
+    // reaches a safepoint, so the new objects need no roots.
+    std::vector<common::Symbol> names;
+    std::vector<common::Object> values;
+    for (const resolver::Export& e: exports)
+    {
+      names.push_back(e.name);
+      values.push_back(globals.GetAt(0, e.slot));
+    }
+    ClassImpl::Methods methods;
+    auto type = heap.Allocate<ClassImpl>(heap,
+                                         "module " + name.ToRawString(),
+                                         common::MakeNone(),
+                                         methods,
+                                         std::make_unique<Shape>(std::move(names)));
+    common::Object obj = type->NewInstance(std::move(values));
+
+    states_[module] = State::DONE;
+    objects_[module] = obj;
+    return obj;
+  }
+
+  void Trace(common::Heap& heap) const
+  {
+    for (const common::Object& obj: objects_)
+    {
+      heap.Mark(obj);
+    }
+  }
+
+private:
+  std::vector<State> states_;
+  std::vector<common::Object> objects_;
+};
+
+} // namespace interpreter
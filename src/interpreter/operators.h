@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+
+#include "common/object.h"
+#include "parser/expr.h"
+
+namespace interpreter
+{
+namespace operators
+{
+
+// Only None and false are falsy.
+inline bool IsTruthy(const common::Object& obj)
+{
+  switch (obj.GetType())
+  {
+    case (common::Object::NONE):
+      return false;
+    case (common::Object::BOOLEAN):
+      return obj.AsBool();
+    default:
+      return true;
+  }
+}
+
+// Whether l / r has an int result; dividing by zero or the smallest int by
+// -1 traps instead.
+inline bool CanDivide(int64_t l, int64_t r)
+{
+  return r != 0 && (r != -1 || l != std::numeric_limits<int64_t>::min());
+}
+
+// Error of an int division that CanDivide() rejects.
+inline std::string GetDivisionError(int64_t r)
+{
+  return r == 0 ? "Division by zero." : "Integer overflow in division.";
+}
+
+template <parser::BinaryOp Op, typename T>
+common::Object Apply(T l, T r)
+{
+  switch (Op)
+  {
+    case parser::BinaryOp::GREATER: return common::MakeBool(l > r);
+    case parser::BinaryOp::GREATER_EQUAL: return common::MakeBool(l >= r);
+    case parser::BinaryOp::LESS: return common::MakeBool(l < r);
+    case parser::BinaryOp::LESS_EQUAL: return common::MakeBool(l <= r);
+    case parser::BinaryOp::ADD: return common::Object(l + r);
+    case parser::BinaryOp::SUBTRACT: return common::Object(l - r);
+    case parser::BinaryOp::MULTIPLY: return common::Object(l * r);
+    case parser::BinaryOp::DIVIDE: return common::Object(l / r);
+    default:
+      throw std::logic_error("operators::Apply called with bad op");
+  }
+}
+
+// Arithmetic and comparison of two numbers: int/int stays int, anything
+// involving a float is computed in double. Returns false if either operand is
+// not a number or the division of two ints traps, leaving strings and errors
+// to the caller.
+template <parser::BinaryOp Op>
+bool ApplyNumeric(const common::Object& left, const common::Object& right, common::Object& result)
+{
+  common::Object::Type l = left.GetType();
+  common::Object::Type r = right.GetType();
+  if (l == common::Object::INT)
+  {
+    if (r == common::Object::INT)
+    {
+      if (Op == parser::BinaryOp::DIVIDE && !CanDivide(left.AsInt(), right.AsInt()))
+      {
+        return false;
+      }
+      result = Apply<Op, int64_t>(left.AsInt(), right.AsInt());
+      return true;
+    }
+    if (r == common::Object::FLOAT)
+    {
+      result = Apply<Op, double>(left.AsInt(), right.AsFloat());
+      return true;
+    }
+  }
+  else if (l == common::Object::FLOAT)
+  {
+    if (r == common::Object::FLOAT)
+    {
+      result = Apply<Op, double>(left.AsFloat(), right.AsFloat());
+      return true;
+    }
+    if (r == common::Object::INT)
+    {
+      result = Apply<Op, double>(left.AsFloat(), right.AsInt());
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace operators
+} // namespace interpreter
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/symbol.h"
+
+namespace interpreter
+{
+
+// Layout descriptor shared by instances that got the same fields in the same
+// order. Each field maps to a fixed index in the instance's value array.
+// Adding a field moves an instance to a child shape; children are owned by
+// their parent, and the root is owned by the class.
+class Shape
+{
+public:
+  static constexpr size_t kNotFound = static_cast<size_t>(-1);
+
+  // Unique for the lifetime of the process, so caches keyed by it can not
+  // confuse a dead shape with a new one allocated at the same address.
+  const uint64_t kId;
+
+  Shape()
+    : kId(next_id_++)
+  {}
+
+  // Root shape of instances that are made with fields already in place.
+  explicit Shape(std::vector<common::Symbol> fields)
+    : kId(next_id_++),
+      fields_(std::move(fields))
+  {}
+
+  Shape(const Shape&) = delete;
+  Shape& operator=(const Shape&) = delete;
+
+  size_t Find(common::Symbol name) const
+  {
+    // Instances have few fields, a linear scan beats hashing.
+    for (size_t i = 0; i < fields_.size(); ++i)
+    {
+      if (fields_[i] == name)
+      {
+        return i;
+      }
+    }
+    return kNotFound;
+  }
+
+  // Shape with name appended; the new field's slot is the current Size().
+  Shape* AddField(common::Symbol name)
+  {
+    auto it = transitions_.find(name);
+    if (it != transitions_.end())
+    {
+      return it->second.get();
+    }
+
+    auto child = std::make_unique<Shape>();
+    child->fields_ = fields_;
+    child->fields_.push_back(name);
+    return (transitions_[name] = std::move(child)).get();
+  }
+
+  size_t Size() const { return fields_.size(); }
+
+private:
+  static inline std::atomic<uint64_t> next_id_{0};
+
+  std::vector<common::Symbol> fields_;
+  std::unordered_map<common::Symbol, std::unique_ptr<Shape>> transitions_;
+};
+
+} // namespace interpreter
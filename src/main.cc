@@ -1,50 +1,103 @@
 #include <iostream>
-#include <fstream>
-#include <streambuf>
+#include <memory>
 
 
-#include "scanner/scanner.h"
-#include "parser/expr.h"
-#include "parser/stmt.h"
-#include "parser/parser.h"
 // #include "experimental/ast_printer.h"
-#include "resolver/resolver.h"
+#include "frontend/front_end.h"
 #include "interpreter/interpreter.h"
+#include "server/server.h"
+#include "vm/compiler.h"
+#include "vm/bytecode_cache.h"
+#include "vm/vm.h"
+#include "util/mapped_file.h"
+#include "util/source_file.h"
 
-int ReadFile(const char* path)
+struct Options
 {
-  std::ifstream fin(path);
-  if (!fin.is_open())
+  bool use_vm = false;
+  // Keep the compiled script next to the source; only with use_vm.
+  bool cache = false;
+  // Parse function bodies on their first call.
+  bool lazy = false;
+  // Report what the optimizer and the cache did.
+  bool verbose = false;
+  // Serve scripts on this socket instead of running one.
+  const char* socket = nullptr;
+};
+
+int ReadFile(const char* path, const Options& options)
+{
+  util::MappedFile file;
+  if (!file.Open(path))
   {
     std::cerr << "Can not open " << path << "\n";
+    return 1;
   }
+  util::SourceFile source(file.GetContents());
 
-  std::string source((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
-
-  scanner::Scanner scanner(source);
-  std::vector<scanner::Token> tokens = scanner.GetTokens();
-
-  if (scanner.HasError())
+  std::unique_ptr<vm::BytecodeCache> cache;
+  if (options.use_vm && options.cache)
   {
-    return 1;
+    cache = std::make_unique<vm::BytecodeCache>(source, std::string(path) + ".cache");
+    if (std::shared_ptr<vm::FunctionProto> script = cache->Load())
+    {
+      if (options.verbose)
+      {
+        std::cerr << "[CACHE]: loaded " << path << ".cache\n";
+      }
+      vm::VM vm(source);
+      vm.Interpret(script);
+      return 0;
+    }
   }
 
-  parser::Parser parser(source, tokens);
-  std::vector<std::shared_ptr<parser::stmt::Stmt>> statements = parser.Parse();
-
-  if (parser.HasError())
+  // A cached script is compiled in full, so it can not skip anything.
+  frontend::FrontEnd front_end(source, path, options.lazy && !cache);
+  if (!front_end.Run())
   {
     return 1;
   }
 
   // std::cout << AstPrinter::GetValue(*expr) << "\n";
 
-  interpreter::Interpreter interpreter;
-  resolver::Resolver resolver(interpreter);
+  if (options.verbose)
+  {
+    optimizer::Stats stats = front_end.GetOptimizerStats();
+    std::cerr << "[OPTIMIZER]: folded " << stats.folded << " operators, dropped "
+              << stats.groupings << " groupings, short-circuited " << stats.short_circuits
+              << " logical operators, pruned " << stats.dead_branches << " branches\n";
+  }
+
+  if (options.use_vm)
+  {
+    vm::Compiler compiler(front_end.GetResolution());
+    std::shared_ptr<vm::FunctionProto> script;
+    try
+    {
+      script = compiler.Compile(front_end.GetProgram().GetStatements());
+    }
+    catch (const vm::CompileError& e)
+    {
+      std::cerr << "[COMPILER]: " << e.what() << "\n";
+      return 1;
+    }
+    if (cache)
+    {
+      // The cache holds the main script only, so it can not run imports.
+      bool stored = !front_end.HasImports() && cache->Store(*script);
+      if (options.verbose)
+      {
+        std::cerr << "[CACHE]: " << (stored ? "wrote " : "could not write ") << path << ".cache\n";
+      }
+    }
+    vm::VM vm(source, &front_end);
+    vm.Interpret(script);
 
-  resolver.Resolve(statements);
+    return 0;
+  }
 
-  interpreter.Interpret(statements);
+  interpreter::Interpreter interpreter(source, front_end.GetResolution(), &front_end);
+  interpreter.Interpret(front_end.GetProgram().GetStatements());
 
   return 0;
 }
@@ -56,14 +109,50 @@ int RunPrompt()
 
 int main(int argc, const char* argv[])
 {
+  Options options;
+  const char* path = nullptr;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::string(argv[i]) == "--vm")
+    {
+      options.use_vm = true;
+    }
+    else if (std::string(argv[i]) == "--cache")
+    {
+      options.cache = true;
+    }
+    else if (std::string(argv[i]) == "--lazy")
+    {
+      options.lazy = true;
+    }
+    else if (std::string(argv[i]) == "-v")
+    {
+      options.verbose = true;
+    }
+    else if (std::string(argv[i]) == "--serve" && i + 1 < argc)
+    {
+      options.socket = argv[++i];
+    }
+    else
+    {
+      path = argv[i];
+    }
+  }
+
+  if (options.socket)
+  {
+    server::Server server(options.socket, options.use_vm);
+    return server.Run() ? 0 : 1;
+  }
+
   int retval = 0;
-  if (argc > 1)
+  if (path)
   {
-    retval = ReadFile(argv[1]);
+    retval = ReadFile(path, options);
   }
   else
   {
-    retval = ReadFile("./example.inp");
+    retval = ReadFile("./example.inp", options);
     retval = RunPrompt();
   }
   return retval;
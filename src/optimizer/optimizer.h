@@ -0,0 +1,453 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/heap.h"
+#include "common/object.h"
+#include "interpreter/operators.h"
+#include "parser/expr.h"
+#include "parser/program.h"
+#include "parser/stmt.h"
+#include "util/visitor_getter.h"
+
+namespace optimizer
+{
+
+// What one run of the Optimizer changed.
+struct Stats
+{
+  // Unary and binary operators replaced by their constant result.
+  size_t folded = 0;
+  // Parentheses dropped from the tree.
+  size_t groupings = 0;
+  // "and" and "or" with a constant left operand.
+  size_t short_circuits = 0;
+  // If and While statements with a constant condition.
+  size_t dead_branches = 0;
+};
+
+// Rewrites a resolved Program in place: operators on constants are folded,
+// groupings dropped and branches whose condition is known are pruned.
+// Operations that fail at runtime are left alone so that the error is still
+// reported if they are reached. Nothing here touches variables, so the
+// Resolution stays valid.
+class Optimizer: public util::VisitorGetter<Optimizer, parser::Expr, parser::Expr*>,
+                 public parser::IVisitor,
+                 public parser::stmt::IStmtVisitor
+{
+public:
+  explicit Optimizer(parser::Program& program)
+    : program_(program),
+      stmt_(nullptr)
+  {}
+
+  void Optimize()
+  {
+    program_.TruncateStatements(OptimizeList(program_.GetStatements()).size());
+  }
+
+  // Same for a function body parsed after the rest of the program.
+  void Optimize(const parser::stmt::Func& func)
+  {
+    Visit(func);
+  }
+
+  const Stats& GetStats() const { return stats_; }
+
+private:
+  parser::Program& program_;
+  Stats stats_;
+  // Result of the last statement visited, nullptr if it was removed. Every
+  // statement visitor sets it last, after its children are done.
+  parser::stmt::Stmt* stmt_;
+  // Links of the operator chains being folded, see FoldChain().
+  std::vector<const parser::Expr*> chain_;
+
+  // The visitor interfaces pass nodes as const, but the tree belongs to
+  // program_, which is being rewritten.
+  template <typename T>
+  static T& Mutable(const T& node) { return const_cast<T&>(node); }
+
+  void Keep(const parser::stmt::Stmt& stmt) { stmt_ = &Mutable(stmt); }
+
+  void Visit(const parser::stmt::Return& stmt)
+  {
+    if (stmt.value_)
+    {
+      Mutable(stmt).value_ = Fold(stmt.value_);
+    }
+    Keep(stmt);
+  }
+
+  void Visit(const parser::stmt::Block& stmt)
+  {
+    Mutable(stmt).statements_ = OptimizeList(stmt.statements_);
+    Keep(stmt);
+  }
+
+  void Visit(const parser::stmt::Func& stmt)
+  {
+    Mutable(stmt).body_ = OptimizeList(stmt.body_);
+    Keep(stmt);
+  }
+
+  void Visit(const parser::stmt::Class& stmt)
+  {
+    for (parser::stmt::Func* method: stmt.methods_)
+    {
+      Visit(*method);
+    }
+    Keep(stmt);
+  }
+
+  void Visit(const parser::stmt::If& stmt)
+  {
+    parser::stmt::If& node = Mutable(stmt);
+    node.condition_ = Fold(node.condition_);
+    if (const parser::Literal* condition = AsConstant(node.condition_))
+    {
+      ++stats_.dead_branches;
+      parser::stmt::Stmt* taken = interpreter::operators::IsTruthy(condition->val_) ? node.stmt_true_ : node.stmt_false_;
+      stmt_ = taken ? Optimize(taken) : nullptr;
+      return;
+    }
+    node.stmt_true_ = OptimizeBranch(node.stmt_true_);
+    if (node.stmt_false_)
+    {
+      node.stmt_false_ = Optimize(node.stmt_false_);
+    }
+    Keep(stmt);
+  }
+
+  void Visit(const parser::stmt::Expression& stmt)
+  {
+    Mutable(stmt).expr_ = Fold(stmt.expr_);
+    Keep(stmt);
+  }
+
+  void Visit(const parser::stmt::Print& stmt)
+  {
+    Mutable(stmt).expr_ = Fold(stmt.expr_);
+    Keep(stmt);
+  }
+
+  void Visit(const parser::stmt::While& stmt)
+  {
+    parser::stmt::While& node = Mutable(stmt);
+    node.condition_ = Fold(node.condition_);
+    const parser::Literal* condition = AsConstant(node.condition_);
+    if (condition && !interpreter::operators::IsTruthy(condition->val_))
+    {
+      ++stats_.dead_branches;
+      stmt_ = nullptr;
+      return;
+    }
+    node.body_ = OptimizeBranch(node.body_);
+    Keep(stmt);
+  }
+
+  void Visit(const parser::stmt::Var& stmt)
+  {
+    if (stmt.expr_)
+    {
+      Mutable(stmt).expr_ = Fold(stmt.expr_);
+    }
+    Keep(stmt);
+  }
+
+  void Visit(const parser::stmt::Import& stmt)
+  {
+    Keep(stmt);
+  }
+
+  void Visit(const parser::Assign& expr) override
+  {
+    Mutable(expr).value_ = Fold(expr.value_);
+    Return(&Mutable(expr));
+  }
+
+  void Visit(const parser::Get& expr) override
+  {
+    Mutable(expr).object_ = Fold(expr.object_);
+    Return(&Mutable(expr));
+  }
+
+  void Visit(const parser::This& expr) override
+  {
+    Return(&Mutable(expr));
+  }
+
+  void Visit(const parser::Super& expr) override
+  {
+    Return(&Mutable(expr));
+  }
+
+  void Visit(const parser::Set& expr) override
+  {
+    parser::Set& node = Mutable(expr);
+    node.object_ = Fold(node.object_);
+    node.value_ = Fold(node.value_);
+    Return(&node);
+  }
+
+  void Visit(const parser::Binary& expr) override
+  {
+    Return(FoldChain(expr));
+  }
+
+  void Visit(const parser::Logical& expr) override
+  {
+    Return(FoldChain(expr));
+  }
+
+  // Folds a chain of Binary and Logical operators, see
+  // parser::CollectLeftChain(), from its leftmost operand up in a loop. The
+  // chain may run through groupings, as in "((a + b) + c) + d", which are
+  // dropped.
+  parser::Expr* FoldChain(const parser::Expr& expr)
+  {
+    size_t base = chain_.size();
+    const parser::Expr* cur = &expr;
+    while (true)
+    {
+      if (const parser::Expr* left = cur->GetChainLeft())
+      {
+        chain_.push_back(cur);
+        cur = left;
+      }
+      else if (auto grouping = dynamic_cast<const parser::Grouping*>(cur); grouping && parser::IsChainLink(*grouping->expr_))
+      {
+        ++stats_.groupings;
+        cur = grouping->expr_;
+      }
+      else
+      {
+        break;
+      }
+    }
+
+    parser::Expr* left = Fold(&Mutable(*cur));
+    while (chain_.size() > base)
+    {
+      parser::Expr& link = Mutable(*chain_.back());
+      chain_.pop_back();
+      if (auto binary = dynamic_cast<parser::Binary*>(&link))
+      {
+        left = FoldLink(*binary, left);
+      }
+      else
+      {
+        left = FoldLink(static_cast<parser::Logical&>(link), left);
+      }
+    }
+    return left;
+  }
+
+  // Each link takes its left operand already folded.
+  parser::Expr* FoldLink(parser::Binary& node, parser::Expr* left_operand)
+  {
+    node.left_ = left_operand;
+    node.right_ = Fold(node.right_);
+
+    const parser::Literal* left = AsConstant(node.left_);
+    const parser::Literal* right = AsConstant(node.right_);
+    common::Object result;
+    if (left && right && FoldBinary(node.kOp, left->val_, right->val_, result))
+    {
+      ++stats_.folded;
+      return MakeLiteral(result);
+    }
+    return &node;
+  }
+
+  parser::Expr* FoldLink(parser::Logical& node, parser::Expr* left_operand)
+  {
+    node.left_ = left_operand;
+    if (const parser::Literal* left = AsConstant(node.left_))
+    {
+      // Same rule as the interpreter: "or" keeps a truthy left operand,
+      // "and" a falsy one; otherwise the value is the right operand.
+      ++stats_.short_circuits;
+      bool is_or = node.op_.GetType() == scanner::Token::OR;
+      return interpreter::operators::IsTruthy(left->val_) == is_or ? node.left_ : Fold(node.right_);
+    }
+    node.right_ = Fold(node.right_);
+    return &node;
+  }
+
+  void Visit(const parser::Grouping& expr) override
+  {
+    ++stats_.groupings;
+    Return(Fold(expr.expr_));
+  }
+
+  void Visit(const parser::Literal& expr) override
+  {
+    Return(&Mutable(expr));
+  }
+
+  void Visit(const parser::Unary& expr) override
+  {
+    parser::Unary& node = Mutable(expr);
+    node.right_ = Fold(node.right_);
+
+    const parser::Literal* operand = AsConstant(node.right_);
+    common::Object result;
+    if (operand && FoldUnary(node.op_.GetType(), operand->val_, result))
+    {
+      ++stats_.folded;
+      Return(MakeLiteral(result));
+      return;
+    }
+    Return(&node);
+  }
+
+  void Visit(const parser::Variable& expr) override
+  {
+    Return(&Mutable(expr));
+  }
+
+  void Visit(const parser::Call& expr) override
+  {
+    parser::Call& node = Mutable(expr);
+    node.callee_ = Fold(node.callee_);
+    for (parser::Expr*& arg: node.args_)
+    {
+      arg = Fold(arg);
+    }
+    Return(&node);
+  }
+
+  parser::Expr* Fold(parser::Expr* expr)
+  {
+    return GetValue(*expr);
+  }
+
+  // The statement that replaces stmt, nullptr if it has to go.
+  parser::stmt::Stmt* Optimize(parser::stmt::Stmt* stmt)
+  {
+    stmt->Accept(*this);
+    return stmt_;
+  }
+
+  // Same for the body of an If or While, which can not be empty.
+  parser::stmt::Stmt* OptimizeBranch(parser::stmt::Stmt* stmt)
+  {
+    parser::stmt::Stmt* result = Optimize(stmt);
+    return result ? result : program_.GetArena().New<parser::stmt::Block>(util::Span<parser::stmt::Stmt*>(), false);
+  }
+
+  // Optimizes stmts in place and returns the statements that remain.
+  util::Span<parser::stmt::Stmt*> OptimizeList(util::Span<parser::stmt::Stmt*> stmts)
+  {
+    size_t size = 0;
+    for (parser::stmt::Stmt* stmt: stmts)
+    {
+      if (parser::stmt::Stmt* result = Optimize(stmt))
+      {
+        stmts[size++] = result;
+      }
+    }
+    return util::Span<parser::stmt::Stmt*>(stmts.begin(), size);
+  }
+
+  static const parser::Literal* AsConstant(const parser::Expr* expr)
+  {
+    return dynamic_cast<const parser::Literal*>(expr);
+  }
+
+  parser::Expr* MakeLiteral(common::Object val)
+  {
+    return program_.GetArena().New<parser::Literal>(val);
+  }
+
+  common::Object MakeString(std::string text)
+  {
+    // Permanent, like the string literals made by the parser.
+    common::String* string = program_.GetArena().New<common::String>(std::move(text));
+    common::Heap::MarkPermanent(string);
+    return common::Object(common::Object::STRING, string);
+  }
+
+  bool FoldUnary(scanner::Token::Type op, const common::Object& operand, common::Object& result)
+  {
+    if (op == scanner::Token::BANG)
+    {
+      result = common::MakeBool(!interpreter::operators::IsTruthy(operand));
+      return true;
+    }
+    switch (operand.GetType())
+    {
+      case common::Object::INT:
+        if (operand.AsInt() == std::numeric_limits<int64_t>::min())
+        {
+          return false;
+        }
+        result = common::MakeInt(-operand.AsInt());
+        return true;
+      case common::Object::FLOAT:
+        result = common::MakeFloat(-operand.AsFloat());
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool FoldBinary(parser::BinaryOp op, common::Object left, common::Object right, common::Object& result)
+  {
+    switch (op)
+    {
+      case parser::BinaryOp::EQUAL:
+      case parser::BinaryOp::NOT_EQUAL:
+        // Object::IsEqual() rejects booleans.
+        if (left.GetType() == common::Object::BOOLEAN && right.GetType() == common::Object::BOOLEAN)
+        {
+          return false;
+        }
+        result = common::MakeBool(left.IsEqual(right) == (op == parser::BinaryOp::EQUAL));
+        return true;
+      case parser::BinaryOp::GREATER:
+        return FoldArithmetic<parser::BinaryOp::GREATER>(left, right, result);
+      case parser::BinaryOp::GREATER_EQUAL:
+        return FoldArithmetic<parser::BinaryOp::GREATER_EQUAL>(left, right, result);
+      case parser::BinaryOp::LESS:
+        return FoldArithmetic<parser::BinaryOp::LESS>(left, right, result);
+      case parser::BinaryOp::LESS_EQUAL:
+        return FoldArithmetic<parser::BinaryOp::LESS_EQUAL>(left, right, result);
+      case parser::BinaryOp::ADD:
+        return FoldArithmetic<parser::BinaryOp::ADD>(left, right, result);
+      case parser::BinaryOp::SUBTRACT:
+        return FoldArithmetic<parser::BinaryOp::SUBTRACT>(left, right, result);
+      case parser::BinaryOp::MULTIPLY:
+        return FoldArithmetic<parser::BinaryOp::MULTIPLY>(left, right, result);
+      case parser::BinaryOp::DIVIDE:
+        // Integer division that traps is not folded, see
+        // operators::CanDivide(), and fails at runtime instead.
+        return FoldArithmetic<parser::BinaryOp::DIVIDE>(left, right, result);
+    }
+    return false;
+  }
+
+  // Same semantics as Interpreter::EvaluateArithmetic().
+  template <parser::BinaryOp Op>
+  bool FoldArithmetic(const common::Object& left, const common::Object& right, common::Object& result)
+  {
+    if (interpreter::operators::ApplyNumeric<Op>(left, right, result))
+    {
+      return true;
+    }
+    if (Op == parser::BinaryOp::ADD &&
+        (left.GetType() == common::Object::STRING || right.GetType() == common::Object::STRING))
+    {
+      result = MakeString(left.ToString() + right.ToString());
+      return true;
+    }
+    return false;
+  }
+};
+
+} // namespace optimizer
@@ -1,9 +1,10 @@
 #pragma once
 
-#include <memory>
+#include <vector>
 
-#include "scanner/scanner.h"
+#include "scanner/token.h"
 #include "common/object.h"
+#include "util/arena.h"
 
 namespace stmt
 {
@@ -16,8 +17,9 @@ class Stmt;
 namespace parser
 {
   
+// AST nodes are owned by the arena of their Program.
 template <typename T>
-using Ptr = std::shared_ptr<T>;
+using Ptr = T*;
 
 class Assign;
 class Get;
@@ -66,27 +68,33 @@ public:
 
   virtual void Accept(IVisitor& visitor) const = 0;
 
-  virtual ~Expr() {}
+  // Left operand of a link of an operator chain, see CollectLeftChain();
+  // nullptr for other nodes.
+  virtual Expr* GetChainLeft() const { return nullptr; }
+
+protected:
+  // See stmt::Stmt.
+  ~Expr() = default;
 };
 
 
 class This: public Expr
 {
 public:
-  This(Ptr<scanner::Token> name, size_t id)
+  This(scanner::Token name, size_t id)
     : Expr(id),
       name_(name)
   {}
 
   void Accept(IVisitor& visitor) const override { visitor.Visit(*this); }
 
-  Ptr<scanner::Token> name_;
+  scanner::Token name_;
 };
 
 class Super: public Expr
 {
 public:
-  Super(Ptr<scanner::Token> name, Ptr<scanner::Token> method, size_t id)
+  Super(scanner::Token name, scanner::Token method, size_t id)
     : Expr(id),
       name_(name),
       method_(method)
@@ -94,29 +102,31 @@ public:
 
   void Accept(IVisitor& visitor) const override { visitor.Visit(*this); }
 
-  Ptr<scanner::Token> name_;
-  Ptr<scanner::Token> method_;
+  scanner::Token name_;
+  scanner::Token method_;
 };
 
 class Get: public Expr
 {
 public:
-  Get(Ptr<Expr> object, Ptr<scanner::Token> name)
-    : object_(object),
+  Get(Ptr<Expr> object, scanner::Token name, size_t id)
+    : Expr(id),
+      object_(object),
       name_(name)
   {}
 
   void Accept(IVisitor& visitor) const override { visitor.Visit(*this); }
 
   Ptr<Expr> object_;
-  Ptr<scanner::Token> name_;
+  scanner::Token name_;
 };
 
 class Set: public Expr
 {
 public:
-  Set(Ptr<Expr> object, Ptr<scanner::Token> name, Ptr<Expr> value)
-    : object_(object),
+  Set(Ptr<Expr> object, scanner::Token name, Ptr<Expr> value, size_t id)
+    : Expr(id),
+      object_(object),
       name_(name),
       value_(value)
   {}
@@ -124,14 +134,14 @@ public:
   void Accept(IVisitor& visitor) const override { visitor.Visit(*this); }
 
   Ptr<Expr> object_;
-  Ptr<scanner::Token> name_;
+  scanner::Token name_;
   Ptr<Expr> value_;
 };
 
 class Assign: public Expr
 {
 public:
-  Assign(Ptr<scanner::Token> name, Ptr<Expr> value, size_t id)
+  Assign(scanner::Token name, Ptr<Expr> value, size_t id)
     : Expr(id),
       name_(name),
       value_(value)
@@ -139,31 +149,70 @@ public:
 
   void Accept(IVisitor& visitor) const override { visitor.Visit(*this); }
 
-  Ptr<Expr> left_;
-  Ptr<scanner::Token> name_;
+  scanner::Token name_;
   Ptr<Expr> value_;
 };
 
+enum class BinaryOp
+{
+  EQUAL,
+  NOT_EQUAL,
+  GREATER,
+  GREATER_EQUAL,
+  LESS,
+  LESS_EQUAL,
+  ADD,
+  SUBTRACT,
+  MULTIPLY,
+  DIVIDE
+};
+
 class Binary: public Expr
 {
 public:
-  Binary(Ptr<Expr> left, Ptr<scanner::Token> op, Ptr<Expr> right)
-    : left_(left),
+  Binary(Ptr<Expr> left, scanner::Token op, Ptr<Expr> right)
+    : kOp(GetBinaryOp(op.GetType())),
+      left_(left),
       op_(op),
       right_(right)
   {}
 
   void Accept(IVisitor& visitor) const override { visitor.Visit(*this); }
 
+  Expr* GetChainLeft() const override { return left_; }
+
+  // Operator kind resolved once at parse time so evaluation never inspects
+  // the token.
+  const BinaryOp kOp;
   Ptr<Expr> left_;
-  Ptr<scanner::Token> op_;
+  scanner::Token op_;
   Ptr<Expr> right_;
+
+private:
+  static BinaryOp GetBinaryOp(scanner::Token::Type type)
+  {
+    switch (type)
+    {
+      case scanner::Token::EQUAL_EQUAL: return BinaryOp::EQUAL;
+      case scanner::Token::BANG_EQUAL: return BinaryOp::NOT_EQUAL;
+      case scanner::Token::GREATER: return BinaryOp::GREATER;
+      case scanner::Token::GREATER_EQUAL: return BinaryOp::GREATER_EQUAL;
+      case scanner::Token::LESS: return BinaryOp::LESS;
+      case scanner::Token::LESS_EQUAL: return BinaryOp::LESS_EQUAL;
+      case scanner::Token::PLUS: return BinaryOp::ADD;
+      case scanner::Token::MINUS: return BinaryOp::SUBTRACT;
+      case scanner::Token::STAR: return BinaryOp::MULTIPLY;
+      case scanner::Token::SLASH: return BinaryOp::DIVIDE;
+      default:
+        throw std::logic_error("Bad binary type.");
+    }
+  }
 };
 
 class Logical: public Expr
 {
 public:
-  Logical(Ptr<Expr> left, Ptr<scanner::Token> op, Ptr<Expr> right)
+  Logical(Ptr<Expr> left, scanner::Token op, Ptr<Expr> right)
     : left_(left),
       op_(op),
       right_(right)
@@ -171,8 +220,10 @@ public:
 
   void Accept(IVisitor& visitor) const override { visitor.Visit(*this); }
 
+  Expr* GetChainLeft() const override { return left_; }
+
   Ptr<Expr> left_;
-  Ptr<scanner::Token> op_;
+  scanner::Token op_;
   Ptr<Expr> right_;
 };
 
@@ -191,8 +242,9 @@ public:
 class Literal: public Expr
 {
 public:
-  Literal(Ptr<scanner::Token> tok)
-    : val_(tok->GetObject())
+  // String values are permanent objects allocated next to the node.
+  Literal(common::Object val)
+    : val_(val)
   {}
 
   void Accept(IVisitor& visitor) const override { visitor.Visit(*this); }
@@ -203,44 +255,71 @@ public:
 class Unary: public Expr
 {
 public:
-  Unary(Ptr<scanner::Token> op, Ptr<Expr> right)
+  Unary(scanner::Token op, Ptr<Expr> right)
     : op_(op),
       right_(right)
   {}
 
   void Accept(IVisitor& visitor) const override { visitor.Visit(*this); }
 
-  Ptr<scanner::Token> op_;
+  scanner::Token op_;
   Ptr<Expr> right_;
 };
 
 class Variable: public Expr
 {
 public:
-  Variable(Ptr<scanner::Token> name, size_t id)
+  Variable(scanner::Token name, size_t id)
     : Expr(id),
       name_(name)
   {}
 
   void Accept(IVisitor& visitor) const override { visitor.Visit(*this); }
 
-  Ptr<scanner::Token> name_;
+  scanner::Token name_;
 };
 
 class Call: public Expr
 {
 public:
-  Call(Ptr<Expr> callee, Ptr<scanner::Token> paren, Ptr<std::vector<Ptr<Expr>>> args)
-    : callee_(callee),
+  Call(Ptr<Expr> callee, scanner::Token paren, util::Span<Ptr<Expr>> args)
+    : kMethod(dynamic_cast<const Get*>(callee)),
+      callee_(callee),
       paren_(paren),
       args_(args)
   {}
 
   void Accept(IVisitor& visitor) const override { visitor.Visit(*this); }
 
+  // The callee when the call has the form "object.name(...)", else nullptr.
+  const Get* const kMethod;
+
   Ptr<Expr> callee_;
-  Ptr<scanner::Token> paren_;
-  Ptr<std::vector<Ptr<Expr>>> args_;
+  scanner::Token paren_;
+  util::Span<Ptr<Expr>> args_;
 };
 
+// Binary and Logical operators associate to the left, so "a + b + c + ..."
+// parses into a tree that is as deep as the chain is long. Passes walk such
+// chains in a loop with these instead of recursing down their left side.
+
+inline bool IsChainLink(const Expr& expr)
+{
+  return expr.GetChainLeft() != nullptr;
+}
+
+// Pushes expr, if it is a link, and the links down its left side onto
+// chain, outermost first, and returns the leftmost operand, which is not a
+// link.
+inline const Expr* CollectLeftChain(const Expr& expr, std::vector<const Expr*>& chain)
+{
+  const Expr* cur = &expr;
+  while (const Expr* left = cur->GetChainLeft())
+  {
+    chain.push_back(cur);
+    cur = left;
+  }
+  return cur;
+}
+
 } // parser
\ No newline at end of file
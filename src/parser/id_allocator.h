@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace parser
+{
+
+// Hands out ranges of Expr::kId values to the parsers of the modules of one
+// program, which may run on different threads, so that ids stay unique
+// across the program and one Resolution covers all of it.
+class IdAllocator
+{
+public:
+  // Parsers take ids in blocks of this many.
+  static constexpr size_t kBlockSize = 1 << 10;
+
+  // First of num_ids new ids.
+  size_t Reserve(size_t num_ids)
+  {
+    return next_.fetch_add(num_ids, std::memory_order_relaxed);
+  }
+
+  // Upper bound of the ids handed out so far.
+  size_t GetNumIds() const { return next_.load(std::memory_order_relaxed); }
+
+private:
+  // Id 0 is never used, as with a Parser that counts its own ids.
+  std::atomic<size_t> next_{1};
+};
+
+} // namespace parser
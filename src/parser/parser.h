@@ -1,170 +1,381 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
+#include <string>
 #include <vector>
 
 #include "scanner/token.h"
-#include "logger.h"
+#include "scanner/token_source.h"
 #include "expr.h"
 #include "stmt.h"
-#include "util/string_tools.h"
+#include "program.h"
+#include "id_allocator.h"
+#include "common/heap.h"
+#include "util/diagnostics.h"
+#include "util/source_file.h"
 
 namespace parser
 {
 
+// Errors go to a util::Diagnostics and do not stop the parse: the statement
+// with the error is dropped and parsing goes on from where the next one
+// likely starts, so that one run finds every error it can.
 class Parser
 {
 public:
-  Parser(const std::string& source, const std::vector<scanner::Token>& tokens)
-    : kSource(source),
-      kTokens(tokens),
-      log_(Logger::kDebug),
+  // Without ids the parser numbers its nodes on its own; with them it takes
+  // ids that are unique across the modules sharing the allocator. A lazy
+  // parser only matches the braces of the bodies of top-level functions and
+  // methods, see ParseSkippedBody().
+  Parser(const util::SourceFile& file,
+         scanner::ITokenSource& tokens,
+         util::Diagnostics& diagnostics,
+         IdAllocator* ids = nullptr,
+         bool lazy = false)
+    : kFile(file),
+      kLazy(lazy),
+      tokens_(tokens),
+      arena_(&program_.GetArena()),
+      diagnostics_(diagnostics),
       error_(false),
-      id_(1)
+      panic_(false),
+      previous_(scanner::Token::END_OF_FILE),
+      ids_(ids),
+      id_(1),
+      id_end_(ids ? 1 : std::numeric_limits<size_t>::max()),
+      num_closures_(0),
+      depth_(0),
+      nesting_(0)
   {}
 
 
-  std::vector<Ptr<stmt::Stmt>> Parse()
+  Program Parse()
   {
-    cur_ = 0;
-    std::vector<Ptr<stmt::Stmt>> statements;
-
     while (Remaining())
     {
-      statements.push_back(ParseDeclarationOrStatement());
+      if (Ptr<stmt::Stmt> stmt = ParseDeclarationOrStatement())
+      {
+        program_.AddStatement(stmt);
+      }
     }
 
-    return statements;
+    return std::move(program_);
+  }
+
+  // Parses the body of func, which a lazy parse skipped, from tokens that
+  // cover the range in func.skipped_. The nodes are added to program, the
+  // Program of func. False on errors, which have been recorded.
+  bool ParseSkippedBody(stmt::Func& func, Program& program)
+  {
+    arena_ = &program.GetArena();
+    ids_ = nullptr;
+    id_ = func.skipped_->first_id;
+    id_end_ = func.skipped_->end_id;
+    ++depth_;
+
+    func.body_ = ParseBlock();
+    return !error_;
   }
 
   bool HasError() { return error_; }
 
+  // Upper bound of the Expr::kId values handed out so far, without an
+  // IdAllocator.
+  size_t GetNumIds() const { return id_; }
+
 private:
-  const std::string& kSource;
-  const std::vector<scanner::Token>& kTokens;
-  size_t cur_;
-  Logger log_;
+  // Most arguments of a call and parameters of a function, in both engines,
+  // so that the VM counts them in one byte.
+  static constexpr size_t kMaxArgs = 255;
+
+  const util::SourceFile& kFile;
+  const bool kLazy;
+  scanner::ITokenSource& tokens_;
+  Program program_;
+  // Where new nodes go: program_, or the Program of a skipped body.
+  util::Arena* arena_;
+  util::Diagnostics& diagnostics_;
   bool error_;
+  // Set from an error until the parser has skipped to the next statement;
+  // errors on the way are most likely caused by the first one and are not
+  // reported.
+  bool panic_;
+  // Type of the last token consumed.
+  scanner::Token::Type previous_;
+  IdAllocator* ids_;
+  // Ids [id_, id_end_) are free to use.
   size_t id_;
+  size_t id_end_;
+  // Function and class declarations parsed so far; used to tell whether a
+  // scope contains any.
+  size_t num_closures_;
+  // Blocks and function bodies the parser is in.
+  size_t depth_;
+  // How deep the tree being parsed nests, which later stages walk by
+  // recursion. Statements, expressions parsed by recursion, postfix links and
+  // pending operators each cost about what they take of the native stack
+  // there: kLevel, more for calls and less for the operators of GetCost().
+  // kMaxNesting leaves the deepest trees a fraction of the stack.
+  static constexpr size_t kLevel = 4;
+  static constexpr size_t kMaxNesting = 1 << 16;
+  size_t nesting_;
+
+  // Counts a level for as long as it lives.
+  class NestingGuard
+  {
+  public:
+    NestingGuard(Parser& parser, size_t cost = kLevel)
+      : nesting_(parser.nesting_),
+        cost_(cost)
+    {
+      nesting_ += cost_;
+      parser.CheckNesting();
+    }
+
+    ~NestingGuard()
+    {
+      nesting_ -= cost_;
+    }
+
+  private:
+    size_t& nesting_;
+    size_t cost_;
+  };
 
+  // Operators waiting for their right operand in ParseOperators(), and the
+  // operands parsed so far.
+  struct PendingOp
+  {
+    scanner::Token tok;
+    int precedence;
+  };
+  static constexpr int kParenPrecedence = 0;
+  static constexpr int kPrefixPrecedence = 7;
+  std::vector<PendingOp> ops_;
+  std::vector<Ptr<Expr>> operands_;
+
+  // What an operator of the precedence adds to nesting_ while pending.
+  static size_t GetCost(int precedence)
+  {
+    if (precedence == kParenPrecedence)
+    {
+      return 1;
+    }
+    return precedence == kPrefixPrecedence ? kLevel / 2 : kLevel;
+  }
+
+  // nullptr if the statement has errors, which have been recorded.
   Ptr<stmt::Stmt> ParseDeclarationOrStatement()
   {
-    try
+    const char* start = GetCurrentToken().GetLexeme().data();
+    Ptr<stmt::Stmt> stmt = ParseDeclarationOrStatementUnchecked();
+    if (!panic_)
     {
-      if (GetCurrentToken().GetType() == scanner::Token::VAR)
-      {
-        ++cur_;
-        return ParseVarDeclaration();
-      }
-      if (GetCurrentToken().GetType() == scanner::Token::FUNC)
-      {
-        ++cur_;
-        return ParseFuncDeclaration();
-      }
-      if (GetCurrentToken().GetType() == scanner::Token::CLASS)
-      {
-        ++cur_;
-        return ParseClassDeclaration();
-      }
+      return stmt;
+    }
 
-      return ParseStmt();
+    // A statement that failed on its first token must still move past it.
+    if (GetCurrentToken().GetLexeme().data() == start && Remaining())
+    {
+      Advance();
+    }
+    Synchronize();
+    // Errors that follow at the end of the input are caused by this one, like
+    // the braces that a statement cut short by CheckNesting() leaves open.
+    panic_ = !Remaining();
+    return nullptr;
+  }
+
+  Ptr<stmt::Stmt> ParseDeclarationOrStatementUnchecked()
+  {
+    if (GetCurrentToken().GetType() == scanner::Token::VAR)
+    {
+      Advance();
+      return ParseVarDeclaration();
+    }
+    if (GetCurrentToken().GetType() == scanner::Token::FUNC)
+    {
+      Advance();
+      return ParseFuncDeclaration();
+    }
+    if (GetCurrentToken().GetType() == scanner::Token::CLASS)
+    {
+      Advance();
+      return ParseClassDeclaration();
     }
-    catch (const std::runtime_error& e)
+    if (GetCurrentToken().GetType() == scanner::Token::IMPORT)
     {
-      Synchronize();
-      return nullptr;
+      Advance();
+      return ParseImportDeclaration();
     }
 
-    return ParseExpressionStmt();
+    return ParseStmt();
   }
 
   Ptr<stmt::Func> ParseFuncDeclaration()
   {
+    NestingGuard nesting(*this);
+    ++num_closures_;
     ExpectToken(scanner::Token::IDENTIFIER, "identifier", false);
-    Ptr<scanner::Token> name = std::make_shared<scanner::Token>(GetCurrentTokenAndIncremetIterator());
+    scanner::Token name = GetCurrentTokenAndIncremetIterator();
 
-    Ptr<std::vector<Ptr<scanner::Token>>> params = std::make_shared<std::vector<Ptr<scanner::Token>>>();
+    std::vector<scanner::Token> params;
 
     ExpectToken(scanner::Token::LEFT_PAREN, "(");
     if (GetCurrentToken().GetType() != scanner::Token::RIGHT_PAREN)
     {
-      params->push_back(std::make_shared<scanner::Token>(GetCurrentTokenAndIncremetIterator()));
+      params.push_back(GetCurrentTokenAndIncremetIterator());
       while (GetCurrentToken().GetType() == scanner::Token::COMMA)
       {
-        ++cur_;
-        params->push_back(std::make_shared<scanner::Token>(GetCurrentTokenAndIncremetIterator()));
+        Advance();
+        if (params.size() == kMaxArgs)
+        {
+          Error(GetCurrentToken(), "Can not have more than 255 parameters.");
+        }
+        params.push_back(GetCurrentTokenAndIncremetIterator());
       }
     }
     ExpectToken(scanner::Token::RIGHT_PAREN, ")");
 
-    ExpectToken(scanner::Token::LEFT_BRACE, "{");
-    Ptr<std::vector<Ptr<stmt::Stmt>>> body = ParseBlock();
+    scanner::Token brace = ExpectToken(scanner::Token::LEFT_BRACE, "{");
+    if (kLazy && depth_ == 0)
+    {
+      return SkipFuncBody(name, params, brace);
+    }
+    size_t num_closures = num_closures_;
+    util::Span<Ptr<stmt::Stmt>> body = ParseBlock();
 
-    return std::make_shared<stmt::Func>(name, params, body);
+    return New<stmt::Func>(name, MakeSpan(params), body, num_closures_ != num_closures);
+  }
+
+  // Moves past a function body matching braces only. Every id the body's
+  // nodes can take comes from an identifier, "this", "super" or "=" token, so
+  // counting those reserves enough of them.
+  Ptr<stmt::Func> SkipFuncBody(const scanner::Token& name,
+                               const std::vector<scanner::Token>& params,
+                               const scanner::Token& brace)
+  {
+    size_t depth = 1;
+    size_t num_ids = 0;
+    bool has_closures = false;
+    const char* end = nullptr;
+    while (depth > 0)
+    {
+      if (!Remaining())
+      {
+        ExpectToken(scanner::Token::RIGHT_BRACE, "}");
+        return New<stmt::Func>(name, MakeSpan(params), util::Span<Ptr<stmt::Stmt>>(), has_closures);
+      }
+      scanner::Token tok = GetCurrentTokenAndIncremetIterator();
+      switch (tok.GetType())
+      {
+        case scanner::Token::LEFT_BRACE:
+          ++depth;
+          break;
+        case scanner::Token::RIGHT_BRACE:
+          --depth;
+          end = tok.GetLexeme().data() + 1;
+          break;
+        case scanner::Token::IDENTIFIER:
+        case scanner::Token::THIS:
+        case scanner::Token::SUPER:
+        case scanner::Token::EQUAL:
+          ++num_ids;
+          break;
+        case scanner::Token::FUNC:
+        case scanner::Token::CLASS:
+          has_closures = true;
+          break;
+        default:
+          break;
+      }
+    }
+
+    const char* text = kFile.GetText().data();
+    size_t first_id = ReserveIds(num_ids);
+    auto func = New<stmt::Func>(name, MakeSpan(params), util::Span<Ptr<stmt::Stmt>>(), has_closures);
+    func->skipped_ = New<stmt::SkippedBody>(stmt::SkippedBody{
+      static_cast<size_t>(brace.GetLexeme().data() + 1 - text),
+      static_cast<size_t>(end - text),
+      first_id,
+      first_id + num_ids});
+    return func;
   }
 
   Ptr<stmt::Stmt> ParseClassDeclaration()
   {
+    ++num_closures_;
     ExpectToken(scanner::Token::IDENTIFIER, "identifier", false);
-    Ptr<scanner::Token> name = std::make_shared<scanner::Token>(GetCurrentTokenAndIncremetIterator());
+    scanner::Token name = GetCurrentTokenAndIncremetIterator();
 
-    Ptr<Variable> super;
+    Ptr<Variable> super = nullptr;
     if (GetCurrentToken().GetType() == scanner::Token::COLON)
     {
-      ++cur_;
+      Advance();
       ExpectToken(scanner::Token::IDENTIFIER, "identifier", false);
-      super = std::make_shared<Variable>(std::make_shared<scanner::Token>(GetCurrentTokenAndIncremetIterator()), id_++);
+      super = New<Variable>(GetCurrentTokenAndIncremetIterator(), NextId());
     }
 
     ExpectToken(scanner::Token::LEFT_BRACE, "{");
 
-    Ptr<std::vector<Ptr<stmt::Func>>> methods = std::make_shared<std::vector<Ptr<stmt::Func>>>();
+    std::vector<Ptr<stmt::Func>> methods;
     while (GetCurrentToken().GetType() != scanner::Token::RIGHT_BRACE && Remaining())
     {
-      methods->push_back(ParseFuncDeclaration());
+      methods.push_back(ParseFuncDeclaration());
     }
 
     ExpectToken(scanner::Token::RIGHT_BRACE, "}");
 
-    return std::make_shared<stmt::Class>(name, super, methods);
+    return New<stmt::Class>(name, super, MakeSpan(methods));
+  }
+
+  Ptr<stmt::Stmt> ParseImportDeclaration()
+  {
+    scanner::Token name = ExpectToken(scanner::Token::IDENTIFIER, "module name");
+    ExpectToken(scanner::Token::SEMICOLON, ";");
+
+    return New<stmt::Import>(name);
   }
 
   Ptr<stmt::Stmt> ParseVarDeclaration()
   {
     ExpectToken(scanner::Token::IDENTIFIER, "identifier", false);
-    Ptr<scanner::Token> name = std::make_shared<scanner::Token>(GetCurrentTokenAndIncremetIterator());
+    scanner::Token name = GetCurrentTokenAndIncremetIterator();
 
     Ptr<Expr> expr = nullptr;
     if (GetCurrentToken().GetType() == scanner::Token::EQUAL)
     {
-      ++cur_;
+      Advance();
       expr = ParseExpr();
     }
 
     ExpectToken(scanner::Token::SEMICOLON, ";");
 
-    return std::make_shared<stmt::Var>(name, expr);
+    return New<stmt::Var>(name, expr);
   }
 
   Ptr<stmt::Stmt> ParseStmt()
   {
+    NestingGuard nesting(*this);
     if (GetCurrentToken().GetType() == scanner::Token::IF)
     {
-      ++cur_;
+      Advance();
       return ParseIfStmt();
     }
     if (GetCurrentToken().GetType() == scanner::Token::PRINT)
     {
-      ++cur_;
+      Advance();
       return ParsePrintStmt();
     }
     if (GetCurrentToken().GetType() == scanner::Token::WHILE)
     {
-      ++cur_;
+      Advance();
       return ParseWhileStmt();
     }
     if (GetCurrentToken().GetType() == scanner::Token::LEFT_BRACE)
     {
-      ++cur_;
+      Advance();
       return ParseBlockStmt();
     }
     if (GetCurrentToken().GetType() == scanner::Token::RETURN)
@@ -177,9 +388,9 @@ private:
 
   Ptr<stmt::Stmt> ParseReturnStmt()
   {
-    auto tok = std::make_shared<scanner::Token>(GetCurrentTokenAndIncremetIterator());
+    scanner::Token tok = GetCurrentTokenAndIncremetIterator();
 
-    std::shared_ptr<Expr> value;
+    Ptr<Expr> value = nullptr;
     if (GetCurrentToken().GetType() != scanner::Token::SEMICOLON)
     {
       value = ParseExpr();
@@ -187,7 +398,7 @@ private:
 
     ExpectToken(scanner::Token::SEMICOLON, ";");
 
-    return std::make_shared<stmt::Return>(tok, value);
+    return New<stmt::Return>(tok, value);
   }
 
   Ptr<stmt::Stmt> ParseWhileStmt()
@@ -198,7 +409,7 @@ private:
 
     Ptr<stmt::Stmt> body = ParseStmt();
 
-    return std::make_shared<stmt::While>(condition, body);
+    return New<stmt::While>(condition, body);
   }
 
   Ptr<stmt::Stmt> ParseIfStmt()
@@ -211,30 +422,37 @@ private:
     Ptr<stmt::Stmt> stmt_false = nullptr;
     if (GetCurrentToken().GetType() == scanner::Token::ELSE)
     {
-      ++cur_;
+      Advance();
       stmt_false = ParseStmt();
     }
 
-    return std::make_shared<stmt::If>(condition, stmt_true, stmt_false);
+    return New<stmt::If>(condition, stmt_true, stmt_false);
   }
 
-  Ptr<std::vector<Ptr<stmt::Stmt>>> ParseBlock()
+  util::Span<Ptr<stmt::Stmt>> ParseBlock()
   {
-    Ptr<std::vector<Ptr<stmt::Stmt>>> statements = std::make_shared<std::vector<Ptr<stmt::Stmt>>>();
+    std::vector<Ptr<stmt::Stmt>> statements;
 
+    ++depth_;
     while (GetCurrentToken().GetType() != scanner::Token::RIGHT_BRACE && Remaining())
     {
-      statements->push_back(ParseDeclarationOrStatement());
+      if (Ptr<stmt::Stmt> stmt = ParseDeclarationOrStatement())
+      {
+        statements.push_back(stmt);
+      }
     }
+    --depth_;
 
     ExpectToken(scanner::Token::RIGHT_BRACE, "}");
 
-    return statements;
+    return MakeSpan(statements);
   }
 
   Ptr<stmt::Stmt> ParseBlockStmt()
   {
-    return std::make_shared<stmt::Block>(ParseBlock());
+    size_t num_closures = num_closures_;
+    util::Span<Ptr<stmt::Stmt>> statements = ParseBlock();
+    return New<stmt::Block>(statements, num_closures_ != num_closures);
   }
 
   Ptr<stmt::Stmt> ParsePrintStmt()
@@ -242,7 +460,7 @@ private:
     Ptr<Expr> expr = ParseExpr();
 
     ExpectToken(scanner::Token::SEMICOLON, ";");
-    return std::make_shared<stmt::Print>(expr);
+    return New<stmt::Print>(expr);
   }
 
   Ptr<stmt::Stmt> ParseExpressionStmt()
@@ -250,7 +468,7 @@ private:
     Ptr<Expr> expr = ParseExpr();
 
     ExpectToken(scanner::Token::SEMICOLON, ";");
-    return std::make_shared<stmt::Expression>(expr);
+    return New<stmt::Expression>(expr);
   }
 
   bool Remaining()
@@ -258,191 +476,320 @@ private:
     return GetCurrentToken().GetType() != scanner::Token::END_OF_FILE;
   }
 
-  bool Synchronize()
+  // Reports nesting deeper than kMaxNesting, with extra levels on top of the
+  // counted ones, and skips the rest of the input so that the parse unwinds
+  // without going deeper.
+  void CheckNesting(size_t extra = 0)
   {
+    if (nesting_ + extra * kLevel <= kMaxNesting)
+    {
+      return;
+    }
+    Error(GetCurrentToken(), "Nesting is too deep.");
     while (Remaining())
     {
-      if (GetCurrentToken().GetType() == scanner::Token::SEMICOLON)
-      {
-        ++cur_;
-        return true;
-      }
+      Advance();
+    }
+  }
+
+  // Skips to where the next statement likely starts: after a semicolon or at
+  // a keyword that begins one.
+  void Synchronize()
+  {
+    while (Remaining() && previous_ != scanner::Token::SEMICOLON)
+    {
       if (GetCurrentToken().OneOf(scanner::Token::CLASS,
                                   scanner::Token::FUNC,
                                   scanner::Token::VAR,
                                   scanner::Token::FOR,
                                   scanner::Token::IF,
+                                  scanner::Token::IMPORT,
                                   scanner::Token::WHILE,
                                   scanner::Token::RETURN))
       {
-        return true;
+        return;
       }
-      ++cur_;
+      Advance();
     }
-    return false;
   }
 
-  const scanner::Token& GetCurrentToken() const { return kTokens[cur_]; }
-
-  const scanner::Token& GetCurrentTokenAndIncremetIterator() { return kTokens[cur_++]; }
+  size_t NextId()
+  {
+    if (id_ == id_end_)
+    {
+      TakeIds(IdAllocator::kBlockSize);
+    }
+    return id_++;
+  }
 
-  Ptr<Expr> ParseExpr()
+  // First of num_ids consecutive ids.
+  size_t ReserveIds(size_t num_ids)
   {
-    try
+    if (id_end_ - id_ < num_ids)
     {
-      return ParseAssign();
+      TakeIds(std::max(num_ids, IdAllocator::kBlockSize));
     }
-    catch (std::runtime_error& e)
+    id_ += num_ids;
+    return id_ - num_ids;
+  }
+
+  void TakeIds(size_t num_ids)
+  {
+    if (!ids_)
     {
-      return {};
+      throw std::logic_error("Skipped body needs more ids than were reserved.");
     }
+    id_ = ids_->Reserve(num_ids);
+    id_end_ = id_ + num_ids;
   }
 
-  Ptr<Expr> ParseAssign()
+  template <typename T, typename ... Args>
+  T* New(Args&& ... args)
   {
-    Ptr<Expr> expr = ParseOr();
+    return arena_->New<T>(std::forward<Args>(args)...);
+  }
 
-    if (GetCurrentToken().GetType() == scanner::Token::EQUAL)
-    {
-      Ptr<scanner::Token> tok = std::make_shared<scanner::Token>(GetCurrentTokenAndIncremetIterator());
-      Ptr<Expr> value = ParseAssign();
+  template <typename T>
+  util::Span<T> MakeSpan(const std::vector<T>& items)
+  {
+    return arena_->MakeSpan(items);
+  }
 
-      if (Variable* ptr = dynamic_cast<Variable*>(expr.get()))
-      {
-        expr = std::make_shared<Assign>(ptr->name_, value, id_++);
-      }
-      else if (Get* ptr = dynamic_cast<Get*>(expr.get()))
-      {
-        expr = std::make_shared<Set>(ptr->object_, ptr->name_, value);
-      }
-      else
+  common::Object MakeLiteral(const scanner::Token& tok)
+  {
+    const scanner::LiteralTable& literals = tokens_.GetLiterals();
+    switch (tok.GetType())
+    {
+      case scanner::Token::STRING:
       {
-        throw std::runtime_error("Bad assignment target.");
+        // Permanent, so shared by every heap that reads it.
+        common::String* string = New<common::String>(literals.GetString(tok));
+        common::Heap::MarkPermanent(string);
+        return common::Object(common::Object::STRING, string);
       }
+      case scanner::Token::INT_LITERAL:
+      case scanner::Token::FLOAT_LITERAL:
+        return literals.GetNumber(tok);
+      case scanner::Token::TRUE:
+        return common::MakeBool(true);
+      case scanner::Token::FALSE:
+        return common::MakeBool(false);
+      default:
+        return common::MakeNone();
     }
-
-    return expr;
   }
 
-  Ptr<Expr> ParseOr()
+  const scanner::Token& GetCurrentToken() { return tokens_.Peek(); }
+
+  scanner::Token GetCurrentTokenAndIncremetIterator()
   {
-    Ptr<Expr> expr = ParseAnd();
+    scanner::Token tok = tokens_.Next();
+    previous_ = tok.GetType();
+    return tok;
+  }
 
-    while (GetCurrentToken().GetType() == scanner::Token::OR)
-    {
-      Ptr<scanner::Token> tok = std::make_shared<scanner::Token>(GetCurrentToken());
-      ++cur_;
-      Ptr<Expr> right = ParseAnd();
-      expr = std::make_shared<Logical>(expr, tok, right);
-    }
+  void Advance() { GetCurrentTokenAndIncremetIterator(); }
 
-    return expr;
+  Ptr<Expr> ParseExpr()
+  {
+    return ParseAssign();
   }
 
-  Ptr<Expr> ParseAnd()
+  Ptr<Expr> ParseAssign()
   {
-    Ptr<Expr> expr = ParseEquality();
+    NestingGuard nesting(*this);
+    Ptr<Expr> expr = ParseOperators();
 
-    while (GetCurrentToken().GetType() == scanner::Token::AND)
+    if (GetCurrentToken().GetType() == scanner::Token::EQUAL)
     {
-      Ptr<scanner::Token> tok = std::make_shared<scanner::Token>(GetCurrentToken());
-      ++cur_;
-      Ptr<Expr> right = ParseEquality();
-      expr = std::make_shared<Logical>(expr, tok, right);
+      expr = FinishAssign(expr);
     }
 
     return expr;
   }
 
-  Ptr<Expr> ParseEquality()
+  // Assigns what follows the current "=" to target.
+  Ptr<Expr> FinishAssign(Ptr<Expr> target)
   {
-    Ptr<Expr> expr = ParseComparison();
+    scanner::Token equal = GetCurrentTokenAndIncremetIterator();
+    Ptr<Expr> value = ParseAssign();
 
-    while (GetCurrentToken().OneOf(scanner::Token::EQUAL_EQUAL, scanner::Token::BANG_EQUAL))
+    if (Variable* ptr = dynamic_cast<Variable*>(target))
+    {
+      return New<Assign>(ptr->name_, value, NextId());
+    }
+    if (Get* ptr = dynamic_cast<Get*>(target))
     {
-      const scanner::Token& op = GetCurrentTokenAndIncremetIterator();
-      Ptr<Expr> right = ParseComparison();
-      expr = std::make_shared<Binary>(expr, std::make_shared<scanner::Token>(op), right);
+      return New<Set>(ptr->object_, ptr->name_, value, NextId());
     }
+    Error(equal, "Bad assignment target.");
+    return target;
+  }
 
-    return expr;
+  // Binding power of a binary operator, 0 for other tokens. Prefix operators
+  // bind tighter than all of them.
+  static int GetPrecedence(scanner::Token::Type type)
+  {
+    switch (type)
+    {
+      case scanner::Token::OR:
+        return 1;
+      case scanner::Token::AND:
+        return 2;
+      case scanner::Token::EQUAL_EQUAL:
+      case scanner::Token::BANG_EQUAL:
+        return 3;
+      case scanner::Token::LESS:
+      case scanner::Token::LESS_EQUAL:
+      case scanner::Token::GREATER:
+      case scanner::Token::GREATER_EQUAL:
+        return 4;
+      case scanner::Token::MINUS:
+      case scanner::Token::PLUS:
+        return 5;
+      case scanner::Token::STAR:
+      case scanner::Token::SLASH:
+        return 6;
+      default:
+        return 0;
+    }
   }
 
-  Ptr<Expr> ParseComparison()
+  // Prefix and binary operators and parentheses around operands, which are
+  // calls or primaries. They are parsed by operator precedence on explicit
+  // stacks rather than by a function per level, so neither long chains nor
+  // deep nesting grow the native stack.
+  Ptr<Expr> ParseOperators()
   {
-    Ptr<Expr> expr = ParseAddition();
+    // The stacks are shared with the calls for the arguments of calls made
+    // from here; the entries above these are this call's.
+    size_t op_base = ops_.size();
+    size_t operand_base = operands_.size();
+    size_t num_parens = 0;
 
-    while (GetCurrentToken().OneOf(scanner::Token::LESS,
-                                   scanner::Token::LESS_EQUAL,
-                                   scanner::Token::GREATER,
-                                   scanner::Token::GREATER_EQUAL))
+    while (true)
     {
-      const scanner::Token& op = GetCurrentTokenAndIncremetIterator();
-      Ptr<Expr> right = ParseAddition();
-      expr = std::make_shared<Binary>(expr, std::make_shared<scanner::Token>(op), right);
-    }
+      while (GetCurrentToken().OneOf(scanner::Token::BANG, scanner::Token::MINUS, scanner::Token::LEFT_PAREN))
+      {
+        scanner::Token tok = GetCurrentTokenAndIncremetIterator();
+        bool is_paren = tok.GetType() == scanner::Token::LEFT_PAREN;
+        num_parens += is_paren;
+        ops_.push_back({tok, is_paren ? kParenPrecedence : kPrefixPrecedence});
+        nesting_ += GetCost(ops_.back().precedence);
+        CheckNesting();
+      }
+      operands_.push_back(ParseCall());
 
-    return expr;
-  }
+      while (num_parens > 0)
+      {
+        if (GetCurrentToken().GetType() == scanner::Token::RIGHT_PAREN)
+        {
+          Advance();
+          CloseParen(op_base);
+          --num_parens;
+          operands_.back() = ParsePostfix(operands_.back());
+        }
+        else if (GetCurrentToken().GetType() == scanner::Token::EQUAL)
+        {
+          // As in "(a = b)": the target is all of the innermost parentheses.
+          Reduce(op_base, kParenPrecedence + 1);
+          operands_.back() = FinishAssign(operands_.back());
+        }
+        else
+        {
+          break;
+        }
+      }
 
-  Ptr<Expr> ParseAddition()
-  {
-    Ptr<Expr> expr = ParseMultiplication();
+      int precedence = GetPrecedence(GetCurrentToken().GetType());
+      if (precedence == 0)
+      {
+        break;
+      }
+      scanner::Token op = GetCurrentTokenAndIncremetIterator();
+      // Left associative: operators of the same precedence go first.
+      Reduce(op_base, precedence);
+      ops_.push_back({op, precedence});
+      nesting_ += GetCost(precedence);
+      CheckNesting();
+    }
 
-    while (GetCurrentToken().OneOf(scanner::Token::MINUS, scanner::Token::PLUS))
+    for (; num_parens > 0; --num_parens)
     {
-      const scanner::Token& op = GetCurrentTokenAndIncremetIterator();
-      Ptr<Expr> right = ParseMultiplication();
-      expr = std::make_shared<Binary>(expr, std::make_shared<scanner::Token>(op), right);
+      ExpectToken(scanner::Token::RIGHT_PAREN, ")");
+      CloseParen(op_base);
     }
+    Reduce(op_base, kParenPrecedence + 1);
 
+    Ptr<Expr> expr = operands_.back();
+    operands_.resize(operand_base);
     return expr;
   }
 
-  Ptr<Expr> ParseMultiplication()
+  // Applies the operators above op_base that bind at least as tight as
+  // precedence, innermost first, stopping at an open parenthesis.
+  void Reduce(size_t op_base, int precedence)
   {
-    Ptr<Expr> expr = ParseUnary();
-
-    while (GetCurrentToken().OneOf(scanner::Token::STAR, scanner::Token::SLASH))
+    while (ops_.size() > op_base && ops_.back().precedence >= precedence)
     {
-      const scanner::Token& op = GetCurrentTokenAndIncremetIterator();
-      Ptr<Expr> right = ParseUnary();
-      expr = std::make_shared<Binary>(expr, std::make_shared<scanner::Token>(op), right);
+      PendingOp op = ops_.back();
+      ops_.pop_back();
+      nesting_ -= GetCost(op.precedence);
+      if (op.precedence == kPrefixPrecedence)
+      {
+        operands_.back() = New<Unary>(op.tok, operands_.back());
+        continue;
+      }
+      Ptr<Expr> right = operands_.back();
+      operands_.pop_back();
+      Ptr<Expr> left = operands_.back();
+      if (op.tok.OneOf(scanner::Token::AND, scanner::Token::OR))
+      {
+        operands_.back() = New<Logical>(left, op.tok, right);
+      }
+      else
+      {
+        operands_.back() = New<Binary>(left, op.tok, right);
+      }
     }
-
-    return expr;
   }
 
-  Ptr<Expr> ParseUnary()
+  // Ends the innermost parentheses, which are done with.
+  void CloseParen(size_t op_base)
   {
-    if (GetCurrentToken().OneOf(scanner::Token::BANG, scanner::Token::MINUS))
+    Reduce(op_base, kParenPrecedence + 1);
+    ops_.pop_back();
+    nesting_ -= GetCost(kParenPrecedence);
+    // "((a))" means "(a)", and generated code can nest parentheses deeply.
+    if (!dynamic_cast<Grouping*>(operands_.back()))
     {
-      const scanner::Token& op = GetCurrentTokenAndIncremetIterator();
-      Ptr<Expr> right = ParseUnary();
-      return std::make_shared<Unary>(std::make_shared<scanner::Token>(op), right);
+      operands_.back() = New<Grouping>(operands_.back());
     }
-
-
-
-    return ParseCall();
   }
 
   Ptr<Expr> ParseCall()
   {
-    Ptr<Expr> expr = ParsePrimary();
+    return ParsePostfix(ParsePrimary());
+  }
 
-    while (1)
+  // Calls and property accesses on expr.
+  Ptr<Expr> ParsePostfix(Ptr<Expr> expr)
+  {
+    // Each link nests the chain before it one level deeper.
+    for (size_t links = 0;; ++links)
     {
+      CheckNesting(links);
       if (GetCurrentToken().GetType() == scanner::Token::LEFT_PAREN)
       {
-        ++cur_;
+        Advance();
+        NestingGuard nesting(*this, 2 * kLevel);
         expr = FinishCall(expr);
       }
       else if (GetCurrentToken().GetType() == scanner::Token::DOT)
       {
-        ++cur_;
-        std::shared_ptr<scanner::Token> name = std::make_shared<scanner::Token>(GetCurrentTokenAndIncremetIterator());
-        expr = std::make_shared<Get>(expr, name);
+        Advance();
+        scanner::Token name = GetCurrentTokenAndIncremetIterator();
+        expr = New<Get>(expr, name, NextId());
       }
       else
       {
@@ -455,23 +802,25 @@ private:
 
   Ptr<Expr> FinishCall(Ptr<Expr> callee)
   {
-    Ptr<std::vector<Ptr<Expr>>> args = std::make_shared<std::vector<Ptr<Expr>>>();
+    std::vector<Ptr<Expr>> args;
 
     if (GetCurrentToken().GetType() != scanner::Token::RIGHT_PAREN)
     {
-      args->push_back(ParseExpr());
+      args.push_back(ParseExpr());
       while (GetCurrentToken().GetType() == scanner::Token::COMMA)
       {
-        ++cur_;
-        args->push_back(ParseExpr());
+        Advance();
+        if (args.size() == kMaxArgs)
+        {
+          Error(GetCurrentToken(), "Can not have more than 255 arguments.");
+        }
+        args.push_back(ParseExpr());
       }
     }
 
-    const scanner::Token& tok = ExpectToken(scanner::Token::RIGHT_PAREN, ")");
-    auto tok_ptr = std::make_shared<scanner::Token>(tok);
-
+    scanner::Token paren = ExpectToken(scanner::Token::RIGHT_PAREN, ")");
 
-    return std::make_shared<Call>(callee, tok_ptr, args);
+    return New<Call>(callee, paren, MakeSpan(args));
   }
 
   Ptr<Expr> ParsePrimary()
@@ -483,54 +832,61 @@ private:
                                 scanner::Token::INT_LITERAL,
                                 scanner::Token::FLOAT_LITERAL))
     {
-      const scanner::Token& op = GetCurrentTokenAndIncremetIterator();
-      return std::make_shared<Literal>(std::make_shared<scanner::Token>(op));
+      return New<Literal>(MakeLiteral(GetCurrentTokenAndIncremetIterator()));
     }
 
     if (GetCurrentToken().GetType() == scanner::Token::THIS)
     {
-      const scanner::Token& op = GetCurrentTokenAndIncremetIterator();
-      return std::make_shared<This>(std::make_shared<scanner::Token>(op), id_++);
+      return New<This>(GetCurrentTokenAndIncremetIterator(), NextId());
     }
 
     if (GetCurrentToken().GetType() == scanner::Token::SUPER)
     {
-      const scanner::Token& name = GetCurrentTokenAndIncremetIterator();
+      scanner::Token name = GetCurrentTokenAndIncremetIterator();
       ExpectToken(scanner::Token::DOT, ".");
-      const scanner::Token& method = ExpectToken(scanner::Token::IDENTIFIER, "method name");
-      return std::make_shared<Super>(std::make_shared<scanner::Token>(name),
-                                     std::make_shared<scanner::Token>(method),
-                                     id_++);
+      scanner::Token method = ExpectToken(scanner::Token::IDENTIFIER, "method name");
+      return New<Super>(name, method, NextId());
     }
 
     if (GetCurrentToken().GetType() == scanner::Token::IDENTIFIER)
     {
-      const scanner::Token& op = GetCurrentTokenAndIncremetIterator();
-      return std::make_shared<Variable>(std::make_shared<scanner::Token>(op), id_++);
+      return New<Variable>(GetCurrentTokenAndIncremetIterator(), NextId());
     }
 
-    ExpectToken(scanner::Token::LEFT_PAREN, "expression");
-    Ptr<Expr> expr = ParseExpr();
-    ExpectToken(scanner::Token::RIGHT_PAREN, ")");
-    return std::make_shared<Grouping>(expr);
+    // Parentheses are taken care of by ParseOperators().
+    const scanner::Token& tok = GetCurrentToken();
+    Error(tok, "Expected \'expression\' before " + tok.ToRawString());
+    // Stands in for the missing operand, so that the tree of a statement
+    // with errors is still complete for the resolver.
+    return New<Literal>(common::MakeNone());
   }
 
-  const scanner::Token& ExpectToken(scanner::Token::Type type, const char* name, bool incremet = true)
+  // Returns the expected token, consumed unless incremet is false. If the
+  // current token is not of type, it is returned as it is after the error.
+  scanner::Token ExpectToken(scanner::Token::Type type, const char* name, bool incremet = true)
   {
     const scanner::Token& tok = GetCurrentToken();
     if (tok.GetType() != type)
     {
-      error_ = true;
-      auto pos = tok.GetPosition(kSource);
-      log_(Logger::kError, "[PARSER]:%d:%d: Expected \'%s\' before %s",
-           pos.first,
-           pos.second,
-           name,
-           tok.ToRawString().c_str());
-      throw std::runtime_error("Unexpected token.");
+      Error(tok, std::string("Expected \'") + name + "\' before " + tok.ToRawString());
+      return tok;
+    }
+    return incremet ? GetCurrentTokenAndIncremetIterator() : tok;
+  }
+
+  void Error(const scanner::Token& tok, std::string message)
+  {
+    error_ = true;
+    if (panic_)
+    {
+      return;
+    }
+    panic_ = true;
+    // The scanner has already reported bad tokens.
+    if (tok.GetType() != scanner::Token::BAD_TOKEN)
+    {
+      diagnostics_.Report("PARSER", tok.GetPosition(kFile), std::move(message));
     }
-    cur_ += incremet;
-    return tok;
   }
 
 };
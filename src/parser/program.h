@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+#include "util/arena.h"
+#include "stmt.h"
+
+namespace parser
+{
+
+// A parsed compilation unit. All of its nodes live in one arena and are
+// released together with it, so the Program must outlive every use of the
+// tree.
+class Program
+{
+public:
+  Program() = default;
+
+  Program(Program&&) = default;
+  Program& operator=(Program&&) = default;
+
+  util::Arena& GetArena() { return arena_; }
+
+  util::Span<stmt::Stmt*> GetStatements()
+  {
+    return util::Span<stmt::Stmt*>(statements_.data(), statements_.size());
+  }
+
+  void AddStatement(stmt::Stmt* stmt) { statements_.push_back(stmt); }
+
+  // Drops the statements from size on, after a pass compacted the list.
+  void TruncateStatements(size_t size) { statements_.resize(size); }
+
+private:
+  util::Arena arena_;
+  std::vector<stmt::Stmt*> statements_;
+};
+
+} // parser
@@ -1,7 +1,6 @@
 #pragma once
 
-#include <vector>
-
+#include "util/arena.h"
 #include "expr.h"
 
 namespace parser
@@ -10,7 +9,7 @@ namespace stmt
 {
 
 template <typename T>
-using Ptr = std::shared_ptr<T>;
+using Ptr = T*;
 
 class Return;
 class Block;
@@ -21,6 +20,7 @@ class Expression;
 class Print;
 class While;
 class Var;
+class Import;
 
 class IStmtVisitor
 {
@@ -34,6 +34,7 @@ public:
   virtual void Visit(const Print&) = 0;
   virtual void Visit(const While&) = 0;
   virtual void Visit(const Var&) = 0;
+  virtual void Visit(const Import&) = 0;
 
   ~IStmtVisitor() {}
 };
@@ -43,47 +44,71 @@ class Stmt
 public:
   virtual void Accept(IStmtVisitor& vis) const = 0;
 
-  ~Stmt() {}
+protected:
+  // Nodes live in the arena of their Program and are never destroyed one by
+  // one; a trivial destructor lets the arena drop them for free.
+  ~Stmt() = default;
 };
 
 class Return: public Stmt
 {
 public:
-  Return(Ptr<scanner::Token> tok, Ptr<Expr> value)
+  Return(scanner::Token tok, Ptr<Expr> value)
     : tok_(tok),
       value_(value)
   {}
 
   void Accept(IStmtVisitor& vis) const { vis.Visit(*this); }
 
-  Ptr<scanner::Token> tok_;
+  scanner::Token tok_;
   Ptr<Expr> value_;
 };
 
+// Where a lazy Parser left the body of a function it did not parse.
+struct SkippedBody
+{
+  // Offsets in the source: just after the "{" and just after the "}".
+  size_t begin;
+  size_t end;
+  // Expr::kId values [first_id, end_id) are reserved for the body's nodes.
+  size_t first_id;
+  size_t end_id;
+};
+
 class Func: public Stmt
 {
 public:
-  Func(Ptr<scanner::Token> name,
-       Ptr<std::vector<Ptr<scanner::Token>>> params,
-       Ptr<std::vector<Ptr<Stmt>>> body)
-  : name_(name),
+  Func(scanner::Token name,
+       util::Span<scanner::Token> params,
+       util::Span<Ptr<Stmt>> body,
+       bool has_closures)
+  : kHasClosures(has_closures),
+    name_(name),
     params_(params),
-    body_(body)
+    body_(body),
+    skipped_(nullptr)
   {}
 
   void Accept(IStmtVisitor& vis) const { vis.Visit(*this); }
 
-  Ptr<scanner::Token> name_;
-  Ptr<std::vector<Ptr<scanner::Token>>> params_;
-  Ptr<std::vector<Ptr<Stmt>>> body_;
+  // The body declares a function or class, so the call environment may
+  // outlive the call.
+  const bool kHasClosures;
+
+  scanner::Token name_;
+  util::Span<scanner::Token> params_;
+  util::Span<Ptr<Stmt>> body_;
+  // Set while body_ is empty because the body has not been parsed yet; see
+  // resolver::IModuleLoader.
+  const SkippedBody* skipped_;
 };
 
 class Class: public Stmt
 {
 public:
-  Class(Ptr<scanner::Token> name,
+  Class(scanner::Token name,
         Ptr<Variable> super,
-        Ptr<std::vector<Ptr<Func>>> methods)
+        util::Span<Ptr<Func>> methods)
   : name_(name),
     super_(super),
     methods_(methods)
@@ -91,9 +116,9 @@ public:
 
   void Accept(IStmtVisitor& vis) const { vis.Visit(*this); }
 
-  Ptr<scanner::Token> name_;
+  scanner::Token name_;
   Ptr<Variable> super_;
-  Ptr<std::vector<Ptr<Func>>> methods_;
+  util::Span<Ptr<Func>> methods_;
 };
 
 class If: public Stmt
@@ -115,13 +140,17 @@ public:
 class Block: public Stmt
 {
 public:
-  Block(Ptr<std::vector<Ptr<Stmt>>> statements)
-  : statements_(statements)
+  Block(util::Span<Ptr<Stmt>> statements, bool has_closures)
+  : kHasClosures(has_closures),
+    statements_(statements)
   {}
 
   void Accept(IStmtVisitor& vis) const { vis.Visit(*this); }
 
-  Ptr<std::vector<Ptr<Stmt>>> statements_;
+  // Same as Func::kHasClosures, for the block's environment.
+  const bool kHasClosures;
+
+  util::Span<Ptr<Stmt>> statements_;
 };
 
 class Expression: public Stmt
@@ -165,16 +194,36 @@ public:
 class Var: public Stmt
 {
 public:
-  Var(Ptr<scanner::Token> name, Ptr<Expr> expr)
+  Var(scanner::Token name, Ptr<Expr> expr)
   : name_(name),
     expr_(expr)
   {}
 
   void Accept(IStmtVisitor& vis) const { vis.Visit(*this); }
 
-  Ptr<scanner::Token> name_;
+  scanner::Token name_;
   Ptr<Expr> expr_;
 };
 
+// "import name;" declares name holding the module object of the script
+// name.inp next to the importing one.
+class Import: public Stmt
+{
+public:
+  static constexpr size_t kNoModule = static_cast<size_t>(-1);
+
+  Import(scanner::Token name)
+  : name_(name),
+    module_(kNoModule)
+  {}
+
+  void Accept(IStmtVisitor& vis) const { vis.Visit(*this); }
+
+  scanner::Token name_;
+  // Index of the module in its program, set by the front end once it has
+  // found the file; see resolver::IModuleLoader.
+  size_t module_;
+};
+
 } // namespace stmt
 } // namespace parser
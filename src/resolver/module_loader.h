@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "common/symbol.h"
+#include "parser/stmt.h"
+#include "util/arena.h"
+#include "util/source_file.h"
+#include "resolution.h"
+
+namespace resolver
+{
+
+// A global a module declares, by name and slot in the module's environment.
+struct Export
+{
+  common::Symbol name;
+  size_t slot;
+};
+
+// What the engines need of the front end while a program runs: the modules
+// it imports (see parser::stmt::Import) and the functions whose body a lazy
+// parse skipped (see parser::stmt::SkippedBody). Module 0 is the main
+// script.
+class IModuleLoader
+{
+public:
+  virtual ~IModuleLoader() = default;
+
+  // Parses, resolves and optimizes the body of func and clears its
+  // skipped_. False if the body has errors, which have been reported.
+  virtual bool Load(const parser::stmt::Func& func) = 0;
+
+  // Where the variables of every module and loaded body are resolved to.
+  virtual const Resolution& GetResolution() const = 0;
+
+  virtual util::Span<parser::stmt::Stmt*> GetStatements(size_t module) const = 0;
+
+  virtual const std::vector<Export>& GetExports(size_t module) const = 0;
+
+  // The source of the module pos points into, nullptr if there is none.
+  virtual const util::SourceFile* FindFile(const char* pos) const = 0;
+};
+
+} // namespace resolver
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace resolver
+{
+
+struct Location
+{
+  size_t depth;
+  size_t slot;
+};
+
+// Resolver output: the location of every resolved variable reference, indexed
+// by Expr::kId. The table is sized once for every id of the program, since
+// the resolvers of its modules fill it from different threads, and once
+// filled it is only read, so one resolved program can be shared by any number
+// of interpreters.
+class Resolution
+{
+public:
+  Resolution() {}
+
+  Resolution(size_t num_ids)
+    : locations_(num_ids, kUnresolved)
+  {}
+
+  // Ids of lazily parsed bodies are reserved while they are skipped, so id
+  // is always one the table was sized for.
+  void Set(size_t id, Location location)
+  {
+    assert(id < locations_.size());
+    locations_[id] = location;
+  }
+
+  const Location* Find(size_t id) const
+  {
+    if (id >= locations_.size() || locations_[id].depth == kUnresolved.depth)
+    {
+      return nullptr;
+    }
+    return &locations_[id];
+  }
+
+  size_t GetNumIds() const { return locations_.size(); }
+
+private:
+  static constexpr Location kUnresolved = {static_cast<size_t>(-1), static_cast<size_t>(-1)};
+
+  std::vector<Location> locations_;
+};
+
+} // namespace resolver
@@ -1,33 +1,45 @@
 #pragma once
 
+#include <iterator>
+#include <limits>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <stdexcept>
 
-#include "util/visitor_getter.h"
-#include "interpreter/interpreter.h"
+#include "common/symbol.h"
 #include "parser/expr.h"
 #include "parser/stmt.h"
+#include "util/diagnostics.h"
+#include "util/source_file.h"
+#include "module_loader.h"
+#include "resolution.h"
 
 namespace resolver
 {
 
+// Errors go to a util::Diagnostics and resolving goes on past them, so that
+// they are all reported at once.
 class Resolver: public parser::IVisitor,
                 public parser::stmt::IStmtVisitor
 {
 public:
-  Resolver(interpreter::Interpreter& interpreter)
-    : interpreter_(interpreter),
-      scopes_(1)
-  {
-    scopes_.back()["print"] = true;
-    scopes_.back()["clock"] = true;
+  Resolver(const util::SourceFile& file, Resolution& resolution, util::Diagnostics& diagnostics)
+    : kFile(file),
+      resolution_(resolution),
+      diagnostics_(diagnostics),
+      scopes_(1),
+      num_visible_globals_(std::numeric_limits<size_t>::max())
+  {
+    // Same order as the builtins defined by the interpreter and the VM.
+    DeclareSpecial(common::Intern("clock"));
+    DeclareSpecial(common::Intern("print"));
+    num_builtins_ = scopes_.front().size();
     context_stack_.push_back(ContextType::GLOBAL);
     class_stack_.push_back(ClassType::NONE);
   }
 
-  void Resolve(const std::vector<std::shared_ptr<parser::stmt::Stmt>>& stmts)
+  void Resolve(util::Span<parser::stmt::Stmt*> stmts)
   {
     for (const auto& s: stmts)
     {
@@ -35,6 +47,43 @@ public:
     }
   }
 
+  // Resolves func, whose body was skipped when the program was resolved and
+  // has been parsed since, as if it had been there all along.
+  void ResolveSkipped(const parser::stmt::Func& func)
+  {
+    auto it = skipped_.find(&func);
+    if (it == skipped_.end())
+    {
+      throw std::logic_error("Function was not skipped.");
+    }
+    Skipped skipped = std::move(it->second);
+    skipped_.erase(it);
+
+    num_visible_globals_ = skipped.num_globals;
+    scopes_.insert(scopes_.end(), skipped.scopes.begin(), skipped.scopes.end());
+    class_stack_.push_back(skipped.class_type);
+
+    ResolveFunction(func, skipped.context_type);
+
+    class_stack_.pop_back();
+    scopes_.resize(1);
+    num_visible_globals_ = std::numeric_limits<size_t>::max();
+  }
+
+  // The globals the resolved statements declared, by slot.
+  std::vector<Export> GetExports() const
+  {
+    std::vector<Export> exports(scopes_.front().size() - num_builtins_);
+    for (const auto& [name, local]: scopes_.front())
+    {
+      if (local.slot >= num_builtins_)
+      {
+        exports[local.slot - num_builtins_] = {name, local.slot};
+      }
+    }
+    return exports;
+  }
+
 private:
   enum class ContextType
   {
@@ -49,16 +98,47 @@ private:
     CLASS
   };
 
-  interpreter::Interpreter& interpreter_;
-  std::vector<std::unordered_map<std::string, bool>> scopes_;
+  // Every scope corresponds to a runtime Environment; the slot of a local is
+  // its index in that Environment.
+  struct Local
+  {
+    bool defined;
+    size_t slot;
+  };
+
+  using Scope = std::unordered_map<common::Symbol, Local>;
+
+  // What the body of a skipped function could see where it was declared.
+  struct Skipped
+  {
+    ContextType context_type;
+    ClassType class_type;
+    // Globals declared before the function.
+    size_t num_globals;
+    // Scopes between the global one and the function's, e.g. "this".
+    std::vector<Scope> scopes;
+  };
+
+  const util::SourceFile& kFile;
+  Resolution& resolution_;
+  util::Diagnostics& diagnostics_;
+  std::vector<Scope> scopes_;
   std::vector<ContextType> context_stack_;
   std::vector<ClassType> class_stack_;
+  size_t num_builtins_;
+  // Globals with a higher slot are declared after the code being resolved.
+  size_t num_visible_globals_;
+  std::unordered_map<const parser::stmt::Func*, Skipped> skipped_;
+  // Operands still to resolve. Operators add theirs here rather than
+  // resolving them on the spot, so that long chains and deep nesting of
+  // operators do not recurse.
+  std::vector<const parser::Expr*> pending_;
 
   void Visit(const parser::stmt::Return& stmt)
   {
     if (context_stack_.back() == ContextType::GLOBAL)
     {
-      throw std::runtime_error("The \"return\" keyword is not allowed in the global context.");
+      Error(stmt.tok_, "The \"return\" keyword is not allowed in the global context.");
     }
     if (stmt.value_)
     {
@@ -69,14 +149,14 @@ private:
   void Visit(const parser::stmt::Block& stmt)
   {
     BeginScope();
-    Resolve(*stmt.statements_);
+    Resolve(stmt.statements_);
     EndScope();
   }
   
   void Visit(const parser::stmt::Func& stmt)
   {
-    Declare(*stmt.name_);
-    Define(*stmt.name_);
+    Declare(stmt.name_);
+    Define(stmt.name_);
 
     ResolveFunction(stmt, ContextType::FUNCTION);
   }
@@ -85,26 +165,26 @@ private:
   {
     class_stack_.push_back(ClassType::CLASS);
 
-    Declare(*stmt.name_);
-    Define(*stmt.name_);
+    Declare(stmt.name_);
+    Define(stmt.name_);
 
     if (stmt.super_)
     {
-      if (stmt.super_->name_->ToRawString() == stmt.name_->ToRawString())
+      if (stmt.super_->name_.GetSymbol() == stmt.name_.GetSymbol())
       {
-        throw std::runtime_error("Class can not inherit itself.");
+        Error(stmt.super_->name_, "Class can not inherit itself.");
       }
 
       Resolve(*stmt.super_);
 
       BeginScope();
-      scopes_.back()["super"] = true;
+      DeclareSpecial(common::symbols::kSuper);
     }
 
     BeginScope();
-    scopes_.back()["this"] = true;
+    DeclareSpecial(common::symbols::kThis);
 
-    for (auto& m: *stmt.methods_)
+    for (auto& m: stmt.methods_)
     {
       ResolveFunction(*m, ContextType::METHOD);
     }
@@ -145,29 +225,40 @@ private:
     Resolve(*stmt.body_);
   }
   
+  void Visit(const parser::stmt::Import& stmt)
+  {
+    // The front end only looks for imports among the top-level statements.
+    if (context_stack_.back() != ContextType::GLOBAL || scopes_.size() != 1)
+    {
+      Error(stmt.name_, "Modules can only be imported at the top level of a script.");
+    }
+    Declare(stmt.name_);
+    Define(stmt.name_);
+  }
+
   void Visit(const parser::stmt::Var& stmt)
   {
-    Declare(*stmt.name_);
+    Declare(stmt.name_);
     if (stmt.expr_)
     {
       Resolve(*stmt.expr_);
     }
-    Define(*stmt.name_);
+    Define(stmt.name_);
   }
   
 
   void Visit(const parser::Super& expr)
   {
-    ResolveLocal(expr, *expr.name_);
+    ResolveLocal(expr, expr.name_);
   }
 
   void Visit(const parser::This& expr)
   {
     if (class_stack_.back() == ClassType::NONE)
     {
-      throw std::runtime_error("Can not use \"this\" outside class.");
+      Error(expr.name_, "Can not use \"this\" outside class.");
     }
-    ResolveLocal(expr, *expr.name_);
+    ResolveLocal(expr, expr.name_);
   }
 
   void Visit(const parser::Get& expr)
@@ -184,24 +275,24 @@ private:
   void Visit(const parser::Assign& expr)
   {
     Resolve(*expr.value_);
-    ResolveLocal(expr, *expr.name_);
+    ResolveLocal(expr, expr.name_);
   }
 
   void Visit(const parser::Binary& expr)
   {
-    Resolve(*expr.left_);
-    Resolve(*expr.right_);
+    pending_.push_back(expr.right_);
+    pending_.push_back(expr.left_);
   }
 
   void Visit(const parser::Logical& expr)
   {
-    Resolve(*expr.left_);
-    Resolve(*expr.right_);
+    pending_.push_back(expr.right_);
+    pending_.push_back(expr.left_);
   }
 
   void Visit(const parser::Grouping& expr)
   {
-    Resolve(*expr.expr_);
+    pending_.push_back(expr.expr_);
   }
 
   void Visit(const parser::Literal& expr)
@@ -211,23 +302,23 @@ private:
 
   void Visit(const parser::Unary& expr)
   {
-    Resolve(*expr.right_);
+    pending_.push_back(expr.right_);
   }
 
   void Visit(const parser::Variable& expr)
   {
-    auto it = scopes_.back().find(expr.name_->ToRawString());
-    if (it != scopes_.back().end() && it->second == false)
+    auto it = scopes_.back().find(expr.name_.GetSymbol());
+    if (it != scopes_.back().end() && !it->second.defined)
     {
-      throw std::runtime_error("Can not access uninitialized variable.");
+      Error(expr.name_, "Can not access uninitialized variable.");
     }
-    ResolveLocal(expr, *expr.name_);
+    ResolveLocal(expr, expr.name_);
   }
 
   void Visit(const parser::Call& expr)
   {
     Resolve(*expr.callee_);
-    for (const auto& arg: *expr.args_)
+    for (const auto& arg: expr.args_)
     {
       Resolve(*arg);
     }
@@ -251,22 +342,43 @@ private:
 
   void Resolve(const parser::Expr& expr)
   {
-    expr.Accept(*this);
+    size_t base = pending_.size();
+    pending_.push_back(&expr);
+    while (pending_.size() > base)
+    {
+      const parser::Expr* next = pending_.back();
+      pending_.pop_back();
+      next->Accept(*this);
+    }
+  }
+
+  void Error(const scanner::Token& tok, std::string message)
+  {
+    diagnostics_.Report("RESOLVER", tok.GetPosition(kFile), std::move(message));
   }
 
   void Declare(const scanner::Token& name)
   {
-    auto it = scopes_.back().find(name.ToRawString());
+    auto it = scopes_.back().find(name.GetSymbol());
     if (it != scopes_.back().end())
     {
-      throw std::runtime_error("Variable \"" + name.ToRawString() + "\" already defined in this scope.");
+      // Uses of the name go to the first declaration.
+      Error(name, "Variable \"" + name.ToRawString() + "\" already defined in this scope.");
+      return;
     }
-    scopes_.back()[name.ToRawString()] = false;
+    size_t slot = scopes_.back().size();
+    scopes_.back()[name.GetSymbol()] = {false, slot};
   }
 
   void Define(const scanner::Token& name)
   {
-    scopes_.back()[name.ToRawString()] = true;
+    scopes_.back()[name.GetSymbol()].defined = true;
+  }
+
+  void DeclareSpecial(common::Symbol name)
+  {
+    size_t slot = scopes_.back().size();
+    scopes_.back()[name] = {true, slot};
   }
 
   void ResolveLocal(const parser::Expr& expr, const scanner::Token& name)
@@ -274,9 +386,15 @@ private:
     size_t depth = 0;
     for (auto it = scopes_.rbegin(); it != scopes_.rend(); ++it)
     {
-      if (it->find(name.ToRawString()) != it->end())
+      auto local = it->find(name.GetSymbol());
+      bool is_global = std::next(it) == scopes_.rend();
+      if (local != it->end() && (!is_global || local->second.slot < num_visible_globals_))
       {
-        interpreter_.Resolve(expr, depth);
+        if (expr.kId == (size_t)-1)
+        {
+          throw std::logic_error("id == -1");
+        }
+        resolution_.Set(expr.kId, {depth, local->second.slot});
         return;
       }
       ++depth;
@@ -285,14 +403,23 @@ private:
 
   void ResolveFunction(const parser::stmt::Func& func, ContextType context_type)
   {
+    if (func.skipped_)
+    {
+      skipped_[&func] = {context_type,
+                         class_stack_.back(),
+                         scopes_.front().size(),
+                         std::vector<Scope>(scopes_.begin() + 1, scopes_.end())};
+      return;
+    }
+
     context_stack_.push_back(context_type);
     BeginScope();
-    for (const auto& t: *func.params_)
+    for (const auto& t: func.params_)
     {
-      Declare(*t);
-      Define(*t);
+      Declare(t);
+      Define(t);
     }
-    Resolve(*func.body_);
+    Resolve(func.body_);
     EndScope();
     context_stack_.pop_back();
   }
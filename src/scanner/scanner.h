@@ -1,426 +1,733 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <future>
+#include <cstdint>
 #include <istream>
 #include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "token.h"
+#include "token_source.h"
 #include "logger.h"
-#include "util/string_tools.h"
+#include "util/diagnostics.h"
+#include "util/simd.h"
+#include "util/source_file.h"
+#include "util/thread_pool.h"
 
 namespace scanner
 {
 
-class Scanner
+// What the first character of a token says about it; GetNextToken()
+// dispatches on this once per token.
+enum class CharKind: uint8_t
+{
+  BAD,
+  SPACE,
+  SINGLE,      // Always a one character token.
+  WITH_EQUAL,  // One character token, or two with a following '='.
+  ALPHA,
+  DIGIT,
+  DOT,
+  QUOTE,
+  SLASH
+};
+
+struct CharInfo
+{
+  CharKind kind;
+  // Token of SINGLE and WITH_EQUAL characters.
+  Token::Type type;
+  // Token of a WITH_EQUAL character followed by '='.
+  Token::Type type_with_equal;
+};
+
+constexpr std::array<CharInfo, 256> MakeCharTable()
+{
+  std::array<CharInfo, 256> table{};
+  for (auto& info: table)
+  {
+    info = {CharKind::BAD, Token::BAD_TOKEN, Token::BAD_TOKEN};
+  }
+
+  for (unsigned char c: {'\n', ' ', '\t', '\r', '\v', '\f'})
+  {
+    table[c].kind = CharKind::SPACE;
+  }
+  for (unsigned char c = 'a'; c <= 'z'; ++c)
+  {
+    table[c].kind = CharKind::ALPHA;
+  }
+  for (unsigned char c = 'A'; c <= 'Z'; ++c)
+  {
+    table[c].kind = CharKind::ALPHA;
+  }
+  table['_'].kind = CharKind::ALPHA;
+  for (unsigned char c = '0'; c <= '9'; ++c)
+  {
+    table[c].kind = CharKind::DIGIT;
+  }
+  table['.'].kind = CharKind::DOT;
+  table['"'].kind = CharKind::QUOTE;
+  table['/'].kind = CharKind::SLASH;
+
+  table['('] = {CharKind::SINGLE, Token::LEFT_PAREN, Token::BAD_TOKEN};
+  table[')'] = {CharKind::SINGLE, Token::RIGHT_PAREN, Token::BAD_TOKEN};
+  table['{'] = {CharKind::SINGLE, Token::LEFT_BRACE, Token::BAD_TOKEN};
+  table['}'] = {CharKind::SINGLE, Token::RIGHT_BRACE, Token::BAD_TOKEN};
+  table[','] = {CharKind::SINGLE, Token::COMMA, Token::BAD_TOKEN};
+  table['+'] = {CharKind::SINGLE, Token::PLUS, Token::BAD_TOKEN};
+  table['-'] = {CharKind::SINGLE, Token::MINUS, Token::BAD_TOKEN};
+  table[':'] = {CharKind::SINGLE, Token::COLON, Token::BAD_TOKEN};
+  table[';'] = {CharKind::SINGLE, Token::SEMICOLON, Token::BAD_TOKEN};
+  table['*'] = {CharKind::SINGLE, Token::STAR, Token::BAD_TOKEN};
+
+  table['!'] = {CharKind::WITH_EQUAL, Token::BANG, Token::BANG_EQUAL};
+  table['='] = {CharKind::WITH_EQUAL, Token::EQUAL, Token::EQUAL_EQUAL};
+  table['>'] = {CharKind::WITH_EQUAL, Token::GREATER, Token::GREATER_EQUAL};
+  table['<'] = {CharKind::WITH_EQUAL, Token::LESS, Token::LESS_EQUAL};
+
+  return table;
+}
+
+constexpr std::array<CharInfo, 256> kCharTable = MakeCharTable();
+
+struct Keyword
+{
+  std::string_view text;
+  Token::Type type;
+};
+
+// Perfect hash of the keywords below; MakeKeywordTable() fails to compile if
+// a new keyword collides.
+constexpr size_t HashKeyword(std::string_view word)
+{
+  return (word.size() * 2 +
+          static_cast<unsigned char>(word.front()) +
+          static_cast<unsigned char>(word.back()) * 10) & 31;
+}
+
+constexpr std::array<Keyword, 32> MakeKeywordTable()
+{
+  // "print" is a builtin function, not a keyword.
+  constexpr Keyword kKeywords[] = {
+    {"and", Token::AND},
+    {"class", Token::CLASS},
+    {"else", Token::ELSE},
+    {"for", Token::FOR},
+    {"func", Token::FUNC},
+    {"if", Token::IF},
+    {"import", Token::IMPORT},
+    {"none", Token::NONE},
+    {"or", Token::OR},
+    {"super", Token::SUPER},
+    {"this", Token::THIS},
+    {"var", Token::VAR},
+    {"return", Token::RETURN},
+    {"while", Token::WHILE},
+    {"Int", Token::INT_TYPE},
+    {"Float", Token::FLOAT_TYPE},
+    {"true", Token::TRUE},
+    {"false", Token::FALSE},
+  };
+
+  std::array<Keyword, 32> table{};
+  for (const Keyword& keyword: kKeywords)
+  {
+    Keyword& slot = table[HashKeyword(keyword.text)];
+    if (!slot.text.empty())
+    {
+      throw std::logic_error("Keyword hash collision.");
+    }
+    slot = keyword;
+  }
+  return table;
+}
+
+constexpr std::array<Keyword, 32> kKeywordTable = MakeKeywordTable();
+
+// IDENTIFIER if word is not a keyword.
+inline Token::Type FindKeyword(std::string_view word)
+{
+  const Keyword& keyword = kKeywordTable[HashKeyword(word)];
+  return keyword.text == word ? keyword.type : Token::IDENTIFIER;
+}
+
+// Either pulled from token by token as an ITokenSource, which lexes on
+// demand, or run over the whole source with GetTokens().
+class Scanner: public ITokenSource
 {
 public:
-  Scanner(const std::string& source)
-    : kSource(source),
-      cur_(kSource.begin()),
+  // Sources at least this large are split across the pool by
+  // GetTokens(util::ThreadPool&).
+  static constexpr size_t kParallelThreshold = 1 << 20;
+
+  // file must outlive the tokens, which point into its text. Lexical errors
+  // go to diagnostics.
+  Scanner(const util::SourceFile& file, util::Diagnostics& diagnostics)
+    : kFile(file),
+      kSource(file.GetText()),
+      cur_(kSource.data()),
       log_(Logger::kWarning),
+      diagnostics_(diagnostics),
       error_(false)
   {
     
   }
 
+  // Scans only [begin, end) of the text of file, e.g. a function body that
+  // a lazy parse skipped. Tokens and positions still refer to the whole text.
+  Scanner(const util::SourceFile& file, util::Diagnostics& diagnostics, size_t begin, size_t end)
+    : kFile(file),
+      kSource(file.GetText().substr(begin, end - begin)),
+      cur_(kSource.data()),
+      log_(Logger::kWarning),
+      diagnostics_(diagnostics),
+      error_(false)
+  {}
+
   std::vector<Token> GetTokens()
   {
     log_(Logger::kDebug, "Scanner started.");
 
     std::vector<Token> result;
-    cur_ = kSource.begin();
+    cur_ = kSource.data();
+    ScanUntil(End(), result);
+    result.push_back(ExtractToken(Token::END_OF_FILE, 0));
 
-    while (true)
+    log_(Logger::kDebug, "Scanner finished with %d tokens.", result.size());
+
+    return result;
+  }
+
+  // Same tokens and diagnostics as GetTokens(). The source is cut after
+  // newlines and the chunks are lexed on pool, each assuming it does not
+  // start inside a string or a block comment. Stitching checks that the
+  // previous chunk really ended at the cut; if it did not, the chunk is
+  // rescanned from where it did until the two meet at a token start.
+  std::vector<Token> GetTokens(util::ThreadPool& pool)
+  {
+    size_t num_chunks = std::min(pool.Size() * 4, kSource.size() / kMinChunkSize);
+    if (kSource.size() < kParallelThreshold || pool.Size() < 2 || num_chunks < 2)
+    {
+      return GetTokens();
+    }
+
+    log_(Logger::kDebug, "Scanner started with %d chunks.", num_chunks);
+
+    std::vector<size_t> cuts = {0};
+    for (size_t i = 1; i < num_chunks; ++i)
     {
-      Token tok = GetNextToken();
-      if (tok.GetType() == Token::EMPTY_TOKEN || tok.GetType() == Token::COMMENT)
+      size_t newline = kSource.find('\n', std::max(cuts.back(), kSource.size() / num_chunks * i));
+      if (newline == std::string_view::npos)
       {
-        continue;
+        break;
       }
-      result.push_back(tok);
-      if (tok.GetType() == Token::END_OF_FILE)
+      cuts.push_back(newline + 1);
+    }
+    cuts.push_back(kSource.size());
+
+    std::vector<std::future<Chunk>> futures;
+    for (size_t i = 0; i + 1 < cuts.size(); ++i)
+    {
+      futures.push_back(pool.Submit([this, begin = cuts[i], end = cuts[i + 1]] {
+        return ScanChunk(begin, end);
+      }));
+    }
+
+    std::vector<Chunk> chunks;
+    size_t num_tokens = 1;
+    for (auto& future: futures)
+    {
+      chunks.push_back(future.get());
+      num_tokens += chunks.back().tokens.size();
+    }
+
+    std::vector<Token> result;
+    result.reserve(num_tokens);
+    size_t reached = 0;
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+      Chunk& chunk = chunks[i];
+      if (chunk.begin == reached)
       {
-        break;
+        Stitch(chunk, 0, result);
+        reached = chunk.end;
+      }
+      else if (reached < cuts[i + 1])
+      {
+        reached = Resync(chunk, reached, cuts[i + 1], result);
       }
+      // Otherwise a token or comment of an earlier chunk covers all of this one.
     }
 
-    log_(Logger::kDebug, "Scanner finished with %d non empty tokens.", result.size());
+    cur_ = End();
+    result.push_back(ExtractToken(Token::END_OF_FILE, 0));
+
+    log_(Logger::kDebug, "Scanner finished with %d tokens.", result.size());
 
     return result;
   }
 
+  const Token& Peek() override
+  {
+    if (!has_next_)
+    {
+      next_ = NextToken();
+      has_next_ = true;
+    }
+    return next_;
+  }
+
+  Token Next() override
+  {
+    Peek();
+    has_next_ = false;
+    return next_;
+  }
+
+  const LiteralTable& GetLiterals() const override
+  {
+    return literals_;
+  }
+
   bool HasError() { return error_; }
 
 private:
-  const std::string& kSource;
-
-  std::string::const_iterator cur_;
+  static constexpr size_t kMinChunkSize = 1 << 18;
 
-  Token cur_token_;
+  // Output of lexing [begin, limit) of the source on a worker.
+  struct Chunk
+  {
+    size_t begin;
+    // Where the last token or comment started before limit ended.
+    size_t end;
+    std::vector<Token> tokens;
+    // Identifier tokens carry indices into names until Stitch() interns them.
+    std::vector<std::string_view> names;
+    LiteralTable literals;
+    // Deferred diagnostics with the offset of their token.
+    std::vector<std::pair<size_t, const char*>> errors;
+  };
+
+  const util::SourceFile& kFile;
+  const std::string_view kSource;
+
+  const char* cur_;
 
   Logger log_;
 
+  util::Diagnostics& diagnostics_;
+
   bool error_;
 
-  Token GetNextToken()
+  // Set on chunk scanners, which must not touch the symbol table or the
+  // diagnostics from worker threads.
+  Chunk* chunk_ = nullptr;
+  std::unordered_map<std::string_view, common::Symbol> chunk_names_;
+
+  LiteralTable literals_;
+
+  // One token of lookahead for Peek().
+  Token next_;
+  bool has_next_ = false;
+
+  Chunk ScanChunk(size_t begin, size_t limit) const
+  {
+    Chunk chunk;
+    chunk.begin = begin;
+
+    Scanner scanner(kFile, diagnostics_);
+    scanner.chunk_ = &chunk;
+    scanner.cur_ = kSource.data() + begin;
+    scanner.ScanUntil(kSource.data() + limit, chunk.tokens);
+    chunk.end = scanner.GetOffset();
+    chunk.literals = std::move(scanner.literals_);
+    return chunk;
+  }
+
+  // Lexes from reached, where the previous chunk really ended, until it
+  // meets a token start of chunk; lexing is stateless between tokens, so
+  // chunk is right from there on. Returns where the chunk ends.
+  size_t Resync(Chunk& chunk, size_t reached, size_t limit, std::vector<Token>& result)
   {
-    if (cur_ == kSource.end())
+    Chunk prefix;
+    prefix.begin = reached;
+
+    Scanner scanner(kFile, diagnostics_);
+    scanner.chunk_ = &prefix;
+    scanner.cur_ = kSource.data() + reached;
+
+    const char* end = kSource.data() + limit;
+    auto next = chunk.tokens.begin();
+    while (true)
     {
-      return ExtractToken(Token::END_OF_FILE, 0);
+      scanner.SkipTrivia(end);
+      const char* pos = scanner.Current();
+      if (pos >= end)
+      {
+        prefix.literals = std::move(scanner.literals_);
+        Stitch(prefix, 0, result);
+        return scanner.GetOffset();
+      }
+
+      while (next != chunk.tokens.end() && next->GetLexeme().data() < pos)
+      {
+        ++next;
+      }
+      if (next != chunk.tokens.end() && next->GetLexeme().data() == pos)
+      {
+        prefix.literals = std::move(scanner.literals_);
+        Stitch(prefix, 0, result);
+        Stitch(chunk, next - chunk.tokens.begin(), result);
+        return chunk.end;
+      }
+
+      prefix.tokens.push_back(scanner.ScanToken());
     }
+  }
 
-    cur_token_ = Token();
-
-    TryGetKeywordToken("and", Token::AND);
-    TryGetKeywordToken("class", Token::CLASS);
-    TryGetKeywordToken("else", Token::ELSE);
-    TryGetKeywordToken("for", Token::FOR);
-    TryGetKeywordToken("func", Token::FUNC);
-    TryGetKeywordToken("if", Token::IF);
-    TryGetKeywordToken("none", Token::NONE);
-    TryGetKeywordToken("or", Token::OR);
-    // TryGetKeywordToken("print", Token::PRINT);
-    TryGetKeywordToken("super", Token::SUPER);
-    TryGetKeywordToken("this", Token::THIS);
-    TryGetKeywordToken("var", Token::VAR);
-    TryGetKeywordToken("return", Token::RETURN);
-    TryGetKeywordToken("while", Token::WHILE);
-    TryGetKeywordToken("Int", Token::INT_TYPE);
-    TryGetKeywordToken("Float", Token::FLOAT_TYPE);
-
-    TryGetBoolToken();
-    TryGetIntToken();
-    TryGetFloatToken();
-    TryGetIdentifierToken();
-    TryGetStringToken();
-
-    if (cur_token_.Length())
+  // Appends the tokens of chunk from first on, with their diagnostics.
+  void Stitch(Chunk& chunk, size_t first, std::vector<Token>& result)
+  {
+    std::vector<common::Symbol> symbols;
+    for (std::string_view name: chunk.names)
     {
-      return ExtractToken(cur_token_);
+      symbols.push_back(common::Intern(name));
     }
+    uint32_t number_base = literals_.NumNumbers();
+    uint32_t string_base = literals_.NumStrings();
+    literals_.Append(std::move(chunk.literals));
 
-    switch (*cur_)
+    auto begin = chunk.tokens.begin() + first;
+    for (auto it = begin; it != chunk.tokens.end(); ++it)
     {
-      case '\n':
-      case ' ':
-      case '\t':
-      case '\r':
-      case '\v': // Vertical tab
-      case '\f': // Formfeed
-        return ExtractToken(Token::EMPTY_TOKEN, 1);
-      case '(': return ExtractToken(Token::LEFT_PAREN, 1);
-      case ')': return ExtractToken(Token::RIGHT_PAREN, 1);
-      case '{': return ExtractToken(Token::LEFT_BRACE, 1);
-      case '}': return ExtractToken(Token::RIGHT_BRACE, 1);
-      case ',': return ExtractToken(Token::COMMA, 1);
-      case '.': return ExtractToken(Token::DOT, 1);
-      case '+': return ExtractToken(Token::PLUS, 1);
-      case '-': return ExtractToken(Token::MINUS, 1);
-      case ':': return ExtractToken(Token::COLON, 1);
-      case ';': return ExtractToken(Token::SEMICOLON, 1);
-      case '*': return ExtractToken(Token::STAR, 1);
-      // Double char op
-      case '!':
-        return MatchChar(1, '=') ? ExtractToken(Token::BANG_EQUAL, 2) : ExtractToken(Token::BANG, 1);
-      case '=':
-        return MatchChar(1, '=') ? ExtractToken(Token::EQUAL_EQUAL, 2) : ExtractToken(Token::EQUAL, 1);
-      case '>':
-        return MatchChar(1, '=') ? ExtractToken(Token::GREATER_EQUAL, 2) : ExtractToken(Token::GREATER, 1);
-      case '<':
-        return MatchChar(1, '=') ? ExtractToken(Token::LESS_EQUAL, 2) : ExtractToken(Token::LESS, 1);
-      // Comments
-      case '/':
-        if (MatchChar(1, '/'))
-        {
-          size_t terminator_pos = kSource.find('\n', GetOffset() + 2);
-          size_t end_pos = terminator_pos != std::string::npos ? terminator_pos + 1 : kSource.size();
-          return ExtractToken(Token::COMMENT, end_pos - GetOffset());
-        }
-        else if (MatchChar(1, '*'))
-        {
-          size_t terminator_pos = kSource.find("*/", GetOffset() + 2);
-          size_t end_pos = terminator_pos != std::string::npos ? terminator_pos + 2 : kSource.size();
-          return ExtractToken(Token::COMMENT, end_pos - GetOffset());
-        }
-        else
-        {
-          return ExtractToken(Token::SLASH, 1);
-        }
-      default:
-        auto pos = util::string_tools::GetPosition(kSource, GetOffset());
-        ReportError("[SCANNER]:%d:%d: bad token.", pos.first, pos.second);
-        return ExtractToken(Token::BAD_TOKEN, 1);
+      std::string_view lexeme = it->GetLexeme();
+      switch (it->GetType())
+      {
+        case Token::IDENTIFIER:
+          *it = Token(Token::IDENTIFIER, lexeme.data(), lexeme.size(), symbols[it->GetSymbol()]);
+          break;
+        case Token::INT_LITERAL:
+        case Token::FLOAT_LITERAL:
+          *it = Token(it->GetType(), lexeme.data(), lexeme.size(), number_base + it->GetLiteralIndex());
+          break;
+        case Token::STRING:
+          *it = Token(Token::STRING, lexeme.data(), lexeme.size(), string_base + it->GetLiteralIndex());
+          break;
+        default:
+          break;
+      }
     }
-  }
 
-  void UpdateCurrentToken(Token::Type type, size_t size)
-  {
-    if (size > cur_token_.Length())
+    size_t offset = begin != chunk.tokens.end() ? begin->GetLexeme().data() - kSource.data() : chunk.end;
+    for (const auto& [error_offset, error]: chunk.errors)
     {
-      cur_token_ = Token(type, &*cur_, size);
+      if (error_offset >= offset)
+      {
+        error_ = true;
+        diagnostics_.Report("SCANNER", kFile.GetPosition(kSource.data() + error_offset), error);
+      }
     }
+
+    result.insert(result.end(), begin, chunk.tokens.end());
   }
 
-  void UpdateCurrentToken(const Token& tok)
+  Token NextToken()
   {
-    if (tok.Length() > cur_token_.Length())
+    SkipTrivia(End());
+    if (cur_ == End())
     {
-      cur_token_ = tok;
+      return ExtractToken(Token::END_OF_FILE, 0);
     }
+    return ScanToken();
   }
 
-  void TryGetKeywordToken(const std::string& target, Token::Type type)
+  // Tokens starting before limit; the last one may end past it.
+  void ScanUntil(const char* limit, std::vector<Token>& result)
   {
-    size_t token_len = target.size();
-    if (MatchStr(target))
+    while (true)
     {
-      UpdateCurrentToken(type, token_len);
+      SkipTrivia(limit);
+      if (Current() >= limit)
+      {
+        return;
+      }
+      result.push_back(ScanToken());
     }
   }
 
-  void TryGetBoolToken()
+  Token ScanToken()
   {
-    if (MatchStr("true"))
+    const CharInfo& info = kCharTable[static_cast<unsigned char>(*cur_)];
+    switch (info.kind)
     {
-      Token tok(Token::TRUE, &*cur_, 4, true);
-      UpdateCurrentToken(tok);
+      case CharKind::SINGLE:
+        return ExtractToken(info.type, 1);
+      case CharKind::WITH_EQUAL:
+        return MatchChar(1, '=') ? ExtractToken(info.type_with_equal, 2) : ExtractToken(info.type, 1);
+      case CharKind::ALPHA:
+        return ScanIdentifierOrKeyword();
+      case CharKind::DIGIT:
+        return ScanNumber();
+      case CharKind::DOT:
+        return (Remaining() > 1 && IsDigit(cur_[1])) ? ScanNumber() : ExtractToken(Token::DOT, 1);
+      case CharKind::QUOTE:
+        return ScanString();
+      case CharKind::SLASH:
+        return ExtractToken(Token::SLASH, 1);
+      case CharKind::SPACE:  // Consumed by SkipTrivia().
+      case CharKind::BAD:
+        break;
     }
-    else if (MatchStr("false"))
+
+    ReportError("bad token.");
+    return ExtractToken(Token::BAD_TOKEN, 1);
+  }
+
+  // Moves past whitespace and comments, which produce no tokens. Whitespace
+  // is not skipped past limit, comments starting before it are.
+  void SkipTrivia(const char* limit)
+  {
+    const char* p = Current();
+    const char* end = End();
+    while (true)
     {
-      Token tok(Token::FALSE, &*cur_, 5, false);
-      UpdateCurrentToken(tok);
+      p = util::simd::SkipWhitespace(p, limit);
+      if (p == limit || end - p < 2 || p[0] != '/')
+      {
+        break;
+      }
+      if (p[1] == '/')
+      {
+        p = util::simd::FindChar(p + 2, end, '\n');
+      }
+      else if (p[1] == '*')
+      {
+        // An unterminated comment runs to the end of the source.
+        p += 2;
+        while ((p = util::simd::FindChar(p, end, '*')) != end && (++p == end || *p != '/')) {}
+        if (p != end)
+        {
+          ++p;
+        }
+      }
+      else
+      {
+        break;
+      }
     }
+    cur_ = p;
   }
 
-  void TryGetIntToken()
+  Token ScanIdentifierOrKeyword()
   {
-    size_t i = 0;
-    while (IsDigit(cur_[i])) { ++i; }
+    size_t i = 1;
+    while (i < Remaining() && IsAlphanum(cur_[i])) { ++i; }
 
-    if (!i)
+    std::string_view word(Current(), i);
+    Token::Type type = FindKeyword(word);
+    if (type == Token::IDENTIFIER)
     {
-      return;
+      return ExtractToken(Token::IDENTIFIER, i, GetName(word));
     }
-
-    int64_t value = std::stoll(std::string(cur_, cur_ + i));
-    Token tok(Token::INT_LITERAL, &*cur_, i, value);
-    UpdateCurrentToken(tok);
+    return ExtractToken(type, i);
   }
 
-  void TryGetFloatToken()
+  common::Symbol GetName(std::string_view word)
   {
-    if (!IsDigit(cur_[0]) && cur_[0] != '.')
+    if (!chunk_)
     {
-      return;
+      return common::Intern(word);
     }
-    size_t i = 0;
-    size_t whole_part_size = 0;
-    size_t fractional_part_size = 0;
-    bool has_dot = false;
-
-    // whole part
-    while (IsDigit(cur_[whole_part_size]))
-    {
-      ++whole_part_size;
-    } 
-    i += whole_part_size;
-
-    if (cur_[i] == '.')
+    auto [it, inserted] = chunk_names_.emplace(word, chunk_->names.size());
+    if (inserted)
     {
-      ++i;
-      has_dot = true;
+      chunk_->names.push_back(word);
     }
+    return it->second;
+  }
 
-    // fractional part
-    while (IsDigit(cur_[i + fractional_part_size]))
-    {
-      ++fractional_part_size;
-    } 
-    i += fractional_part_size;
+  // Ints are digit runs. A dot or an exponent makes a float, either part of
+  // "1.5" may be empty but not both.
+  Token ScanNumber()
+  {
+    const char* begin = Current();
+    const char* end = begin + Remaining();
+    const char* p = begin;
 
-    if (!whole_part_size && !fractional_part_size)
+    while (p != end && IsDigit(*p)) { ++p; }
+
+    bool is_float = false;
+    if (p != end && *p == '.')
     {
-      return;
+      ++p;
+      while (p != end && IsDigit(*p)) { ++p; }
+      is_float = true;
     }
 
-    if (cur_[i] != 'e' && cur_[i] != 'E')
+    if (p != end && (*p == 'e' || *p == 'E'))
     {
-      if (has_dot)
+      const char* exp = p + 1;
+      if (exp != end && (*exp == '-' || *exp == '+'))
       {
-        double value = std::stod(std::string(cur_, cur_ + i));
-        Token tok(Token::FLOAT_LITERAL, &*cur_, i, value);
-        UpdateCurrentToken(tok);
+        ++exp;
+      }
+      // A dangling "e" is not part of the number.
+      if (exp != end && IsDigit(*exp))
+      {
+        while (exp != end && IsDigit(*exp)) { ++exp; }
+        p = exp;
+        is_float = true;
       }
-      return;
-    }
-
-    // exponent
-    size_t mantissa = i;
-    ++i;
-    if ((cur_[i] == '-') || (cur_[i] == '+'))
-    {
-      ++i;
-    }
-
-    if (!IsDigit(cur_[i]))
-    {
-      double value = std::stod(std::string(cur_, cur_ + mantissa));
-      Token tok(Token::FLOAT_LITERAL, &*cur_, mantissa, value);
-      UpdateCurrentToken(tok);
-      return;
     }
 
-    while (IsDigit(cur_[i]))
+    size_t size = p - begin;
+    if (is_float)
     {
-      ++i;
+      double value = 0;
+      std::from_chars(begin, p, value);
+      return ExtractToken(Token::FLOAT_LITERAL, size, literals_.AddNumber(common::MakeFloat(value)));
     }
-    double value = std::stod(std::string(cur_, cur_ + i));
-    Token tok(Token::FLOAT_LITERAL, &*cur_, i, value);
-    UpdateCurrentToken(tok);
-  }
 
-  void TryGetIdentifierToken()
-  {
-    size_t i = 0;
-    if (!IsAlpha(*cur_))
+    int64_t value = 0;
+    if (std::from_chars(begin, p, value).ec != std::errc())
     {
-      return;
+      ReportError("integer literal out of range.");
+      return ExtractToken(Token::BAD_TOKEN, size);
     }
-    ++i;
-
-    while (IsAlphanum(cur_[i])) { ++i; }
-
-
-    std::string value(cur_, cur_ + i);
-    Token tok(Token::IDENTIFIER, &*cur_, i, value);
-    UpdateCurrentToken(tok);
+    return ExtractToken(Token::INT_LITERAL, size, literals_.AddNumber(common::MakeInt(value)));
   }
 
-  void TryGetStringToken()
+  // Plain runs of the body are found with util::simd and copied at once;
+  // only escapes are handled one at a time.
+  Token ScanString()
   {
-    if (*cur_ != '"') return;
-
+    const char* begin = Current();
+    const char* end = End();
     std::string result;
 
-    bool escape = false;
-    for (size_t i = 1; i < Remaining(); ++i)
+    for (const char* p = begin + 1; ; )
     {
-      if (escape)
-      {
-        escape = false;
-        switch (cur_[i])
-        {
-          case 'n':
-            result += '\n';
-            break;
-          case 't':
-            result += '\t';
-            break;
-          case '\\':
-            result += '\\';
-            break;
-          case '\"':
-            result += '\"';
-            break;
-          case '\'':
-            result += '\'';
-            break;
-          default:
-            result += '\\';
-            result += cur_[i];
-        }
-        continue;
-      }
-      if (cur_[i] == '\\')
-      {
-        escape = true;
-        continue;
-      }
-      if (cur_[i] == '"')
+      const char* stop = util::simd::FindStringStop(p, end);
+      result.append(p, stop);
+      if (stop == end || (stop + 1 == end && *stop == '\\'))
       {
-        Token tok(Token::STRING, &*cur_, i + 1, result);
-        UpdateCurrentToken(tok);
-        return;
+        break;
       }
-      if (cur_[i] == '\n')
+      switch (*stop)
       {
-        auto pos = util::string_tools::GetPosition(kSource, GetOffset());
-        ReportError("[SCANNER]:%d:%d: unexpected end of line inside of string.", pos.first, pos.second);
-        UpdateCurrentToken(Token::BAD_TOKEN, i);
-        return;
+        case '"':
+          return ExtractToken(Token::STRING, stop + 1 - begin, literals_.AddString(std::move(result)));
+        case '\n':
+        {
+          ReportError("unexpected end of line inside of string.");
+          return ExtractToken(Token::BAD_TOKEN, stop - begin);
+        }
+        default:
+          AppendEscape(result, stop[1]);
+          p = stop + 2;
       }
-      result += cur_[i];
     }
-    auto pos = util::string_tools::GetPosition(kSource, GetOffset());
-    ReportError("[SCANNER]:%d:%d: invalid symbol.", pos.first, pos.second);
-    UpdateCurrentToken(Token::BAD_TOKEN, Remaining());
+    ReportError("invalid symbol.");
+    return ExtractToken(Token::BAD_TOKEN, Remaining());
   }
 
-  bool MatchStr(const std::string& target)
+  static void AppendEscape(std::string& result, char chr)
   {
-    return (target.size() <= Remaining()) && (kSource.compare(GetOffset(), target.size(), target) == 0);
+    switch (chr)
+    {
+      case 'n':
+        result += '\n';
+        break;
+      case 't':
+        result += '\t';
+        break;
+      case '\\':
+        result += '\\';
+        break;
+      case '\"':
+        result += '\"';
+        break;
+      case '\'':
+        result += '\'';
+        break;
+      default:
+        result += '\\';
+        result += chr;
+    }
   }
 
   bool MatchChar(size_t offset, char chr)
   {
-    std::string::const_iterator target = cur_ + offset;
-    return (target < kSource.end()) && (*target == chr);
+    const char* target = cur_ + offset;
+    return (target < End()) && (*target == chr);
   }
 
-  Token ExtractToken(Token::Type type, size_t size)
+  Token ExtractToken(Token::Type type, size_t size, uint32_t payload = 0)
   {
-    Token tok(type, &*cur_, size);
+    if (size > Token::kMaxSize)
+    {
+      ReportError("token longer than 16MB.");
+      Token tok(Token::BAD_TOKEN, cur_, Token::kMaxSize);
+      cur_ += size;
+      return tok;
+    }
+    Token tok(type, cur_, size, payload);
     cur_ += size;
     return tok;
   }
 
-  Token ExtractToken(Token token)
-  {
-    cur_ += token.Length();
-    return token;
-  }
-
-  size_t GetOffset()
-  {
-    return cur_ - kSource.begin();
-  }
-
-  size_t Remaining()
+  const char* Current()
   {
-    return kSource.end() - cur_;
+    return cur_;
   }
 
-  bool IsInRange(char chr, char lo, char hi)
+  const char* End()
   {
-    return (chr >= lo) && (chr <= hi);
+    return kSource.data() + kSource.size();
   }
 
-  bool IsDigit(char chr)
+  size_t GetOffset()
   {
-    return IsInRange(chr, '0', '9');
+    return cur_ - kSource.data();
   }
 
-  bool IsAlpha(char chr)
+  size_t Remaining()
   {
-    return IsInRange(chr, 'a', 'z') || IsInRange(chr, 'A', 'Z') || (chr == '_');
+    return End() - cur_;
   }
 
-  bool IsAlphanum(char chr)
+  static bool IsDigit(char chr)
   {
-    return IsAlpha(chr) || IsDigit(chr);
+    return kCharTable[static_cast<unsigned char>(chr)].kind == CharKind::DIGIT;
   }
 
-  template <size_t N, typename ... Args>
-  void ReportError(const char (&message)[N], Args ... args)
+  static bool IsAlphanum(char chr)
   {
-    error_ = true;
-    log_(Logger::kError, message, args...);
+    CharKind kind = kCharTable[static_cast<unsigned char>(chr)].kind;
+    return kind == CharKind::ALPHA || kind == CharKind::DIGIT;
   }
 
+  // Reports message at the current position. message must be a literal,
+  // since chunk scanners keep it until their chunk is stitched.
   void ReportError(const char* message)
   {
+    if (chunk_)
+    {
+      chunk_->errors.emplace_back(GetOffset(), message);
+      return;
+    }
     error_ = true;
-    log_(Logger::kError, message);
+    diagnostics_.Report("SCANNER", kFile.GetPosition(Current()), message);
   }
 };
 
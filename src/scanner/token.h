@@ -1,11 +1,17 @@
 #pragma once
 
-#include <memory>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
 #include <string>
-#include <sstream>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-#include "util/string_tools.h"
+#include "util/source_file.h"
 #include "common/object.h"
+#include "common/symbol.h"
 
 
 #define INTERP_FORALL_TOKEN_TYPES(_) \
@@ -47,6 +53,7 @@
   _(FUNC) \
   _(FOR) \
   _(IF) \
+  _(IMPORT) \
   _(NONE) \
   _(OR) \
   _(PRINT) \
@@ -65,56 +72,39 @@
 namespace scanner
 {
 
+// A trivially copyable 16 byte record; tokens are passed and stored by
+// value. Identifiers carry their symbol, number and string literals an index
+// into the LiteralTable of their scanner.
 class Token
 {
 public:
-  enum Type
+  enum Type: uint8_t
   {
 #define INTERP_PUT_WITH_COMMA(_) _,
     INTERP_FORALL_TOKEN_TYPES(INTERP_PUT_WITH_COMMA)
 #undef INTERP_PUT_WITH_COMMA
   };
 
-  explicit Token(Type type, const char* begin, size_t size, bool content)
-    : object_(common::MakeBool(content)),
-      type_(type),
-      begin_(begin),
-      size_(size)
-  {}
-
-  explicit Token(Type type, const char* begin, size_t size, int64_t content)
-    : object_(common::MakeInt(content)),
-      type_(type),
-      begin_(begin),
-      size_(size)
-  {}
-
-  explicit Token(Type type, const char* begin, size_t size, double content)
-    : object_(common::MakeFloat(content)),
-      type_(type),
-      begin_(begin),
-      size_(size)
-  {}
-
-  explicit Token(Type type, const char* begin, size_t size, std::string content)
-    : object_(common::MakeString(content)),
-      type_(type),
-      begin_(begin),
-      size_(size)
-  {}
-
-  template <typename T>
-  Token(Type type, const char* begin, size_t size, T content) = delete;
-
-  Token(Type type, const char* begin, size_t size)
-    : object_(common::MakeNone()),
-      type_(type),
-      begin_(begin),
-      size_(size)
-  {}
+  // Longest token, as its size is stored in 24 bits; the scanner reports
+  // longer ones as errors.
+  static constexpr size_t kMaxSize = (1 << 24) - 1;
+
+  Token(Type type, const char* begin, size_t size, uint32_t payload = 0)
+    : begin_(begin),
+      payload_(payload),
+      size_(static_cast<uint32_t>(size)),
+      type_(type)
+  {
+    assert(size <= kMaxSize);
+  }
 
   Token() : Token(EMPTY_TOKEN, nullptr, 0) {}
 
+  std::string_view GetLexeme() const
+  {
+    return std::string_view(begin_, size_);
+  }
+
   std::string ToRawString() const
   {
     return std::string(begin_, begin_ + size_);
@@ -134,80 +124,104 @@ public:
 
   std::string ToString() const
   {
-    std::stringstream ss;
+    return GetTypeName() + "(\"" + ToRawString() + "\")";
+  }
 
-    ss << GetTypeName();
+  size_t Length() const { return size_; }
 
-    ss << "(\"";
+  Type GetType() const { return static_cast<Type>(type_); }
 
-    switch (type_)
-    {
-      case INT_LITERAL:
-        ss << std::to_string(object_.AsInt());
-        break;
-      case FLOAT_LITERAL:
-        ss << std::to_string(object_.AsFloat());
-        break;
-      case IDENTIFIER:
-      case STRING:
-        ss  << object_.AsString();
-        break;
-      default:
-        ss << std::string(begin_, begin_ + size_);
-    }
-    
-    ss << "\")";
-    return ss.str();
+  template <typename ... Args>
+  bool OneOf(Type first, Args ... other) const
+  {
+    return (GetType() == first) || OneOf(other...);
   }
 
-  size_t Length() const { return size_; }
+  bool OneOf(Type first) const
+  {
+    return GetType() == first;
+  }
 
-  Type GetType() const { return type_; }
+  std::pair<size_t, size_t> GetPosition(const util::SourceFile& file) const
+  {
+    return file.GetPosition(begin_);
+  }
 
-  bool OneOf(const std::vector<Type>& types)
+  // Name of an identifier, "this" or "super" token.
+  common::Symbol GetSymbol() const
   {
-    for (Type t: types)
+    switch (type_)
     {
-      if (type_ == t)
-      {
-        return true;
-      }
+      case THIS:
+        return common::symbols::kThis;
+      case SUPER:
+        return common::symbols::kSuper;
+      default:
+        return payload_;
     }
-    return false;
   }
 
-  template <typename ... Args>
-  bool OneOf(Type first, Args ... other) const
+  // Index of a number or string literal in its LiteralTable.
+  uint32_t GetLiteralIndex() const
   {
-    return (type_ == first) || OneOf(other...);
+    return payload_;
   }
 
-  bool OneOf(Type first) const
+private:
+  const char* begin_;
+  uint32_t payload_;
+  uint32_t size_: 24;
+  uint32_t type_: 8;
+};
+
+static_assert(sizeof(Token) == 16, "Tokens are meant to be 16 bytes.");
+static_assert(std::is_trivially_copyable_v<Token>, "Tokens are copied around freely.");
+
+// Values of the number and string literals of a source.
+class LiteralTable
+{
+public:
+  uint32_t AddNumber(common::Object number)
   {
-    return type_ == first;
+    numbers_.push_back(number);
+    return numbers_.size() - 1;
   }
 
-  std::pair<size_t, size_t> GetPosition(const std::string& source) const
+  uint32_t AddString(std::string string)
   {
-    return util::string_tools::GetPosition(source, begin_ - source.c_str());
+    strings_.push_back(std::move(string));
+    return strings_.size() - 1;
   }
 
-  common::Object& GetObject()
+  // For INT_LITERAL and FLOAT_LITERAL tokens.
+  const common::Object& GetNumber(const Token& token) const
   {
-    return object_;
+    return numbers_[token.GetLiteralIndex()];
   }
 
-  const common::Object& GetObject() const
+  // For STRING tokens.
+  const std::string& GetString(const Token& token) const
   {
-    return object_;
+    return strings_[token.GetLiteralIndex()];
+  }
+
+  size_t NumNumbers() const { return numbers_.size(); }
+
+  size_t NumStrings() const { return strings_.size(); }
+
+  // Appends the literals of other; their indices grow by NumNumbers() and
+  // NumStrings() as they were before the call.
+  void Append(LiteralTable&& other)
+  {
+    numbers_.insert(numbers_.end(), other.numbers_.begin(), other.numbers_.end());
+    strings_.insert(strings_.end(),
+                    std::make_move_iterator(other.strings_.begin()),
+                    std::make_move_iterator(other.strings_.end()));
   }
 
 private:
-  common::Object object_;
-  Type type_;
-  const char* begin_;
-  size_t size_;
+  std::vector<common::Object> numbers_;
+  std::vector<std::string> strings_;
 };
 
-  
 } // scanner
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "token.h"
+
+namespace scanner
+{
+
+// Tokens pulled one at a time by the parser. After the END_OF_FILE token
+// both calls keep returning END_OF_FILE.
+class ITokenSource
+{
+public:
+  virtual ~ITokenSource() = default;
+
+  // The next token, left in place.
+  virtual const Token& Peek() = 0;
+
+  virtual Token Next() = 0;
+
+  // Values of the literal tokens handed out.
+  virtual const LiteralTable& GetLiterals() const = 0;
+};
+
+// Serves tokens lexed up front, e.g. by Scanner::GetTokens(util::ThreadPool&).
+class TokenVectorSource: public ITokenSource
+{
+public:
+  // tokens must end with END_OF_FILE.
+  TokenVectorSource(std::vector<Token> tokens, const LiteralTable& literals)
+    : tokens_(std::move(tokens)),
+      literals_(literals),
+      cur_(0)
+  {}
+
+  const Token& Peek() override
+  {
+    return tokens_[cur_];
+  }
+
+  Token Next() override
+  {
+    Token tok = tokens_[cur_];
+    if (cur_ + 1 < tokens_.size())
+    {
+      ++cur_;
+    }
+    return tok;
+  }
+
+  const LiteralTable& GetLiterals() const override
+  {
+    return literals_;
+  }
+
+private:
+  std::vector<Token> tokens_;
+  const LiteralTable& literals_;
+  size_t cur_;
+};
+
+} // scanner
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "frontend/front_end.h"
+#include "util/file_stamp.h"
+#include "util/mapped_file.h"
+#include "util/source_file.h"
+
+namespace server
+{
+
+// A script taken through the front end once, to be run any number of times.
+// The tree is not lazily parsed, so runs only read it and can share it. The
+// program owns copies of its sources, so that changing its files does not
+// change it, and notes what the files were like before they were read.
+class Program
+{
+public:
+  // Null if path can not be read.
+  static std::shared_ptr<Program> FromFile(const std::string& path)
+  {
+    std::vector<util::FileStamp> stamps{util::FileStamp::Take(path)};
+    util::MappedFile file;
+    if (!file.Read(path.c_str()))
+    {
+      return nullptr;
+    }
+    return std::shared_ptr<Program>(new Program(path, std::string(file.GetContents()), std::move(stamps)));
+  }
+
+  // Imports of source are looked up in the working directory.
+  static std::shared_ptr<Program> FromSource(std::string source)
+  {
+    return std::shared_ptr<Program>(new Program("", std::move(source), {}));
+  }
+
+  Program(const Program&) = delete;
+  Program& operator=(const Program&) = delete;
+
+  // False if the front end found errors; GetErrors() lists them.
+  bool IsOk() const { return ok_; }
+
+  const std::string& GetErrors() const { return errors_; }
+
+  const util::SourceFile& GetFile() const { return file_; }
+
+  frontend::FrontEnd& GetFrontEnd() { return front_end_; }
+
+  // Whether none of the files the program was read from has changed.
+  bool IsCurrent() const
+  {
+    for (const util::FileStamp& stamp: stamps_)
+    {
+      if (!stamp.IsCurrent())
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  const std::string source_;
+  const util::SourceFile file_;
+  std::vector<util::FileStamp> stamps_;
+  // Only written while the front end runs.
+  std::ostringstream errors_stream_;
+  frontend::FrontEnd front_end_;
+  bool ok_ = false;
+  std::string errors_;
+
+  // stamps has the one of the main script, if it is a file.
+  Program(std::string path, std::string source, std::vector<util::FileStamp> stamps)
+    : source_(std::move(source)),
+      file_(source_),
+      stamps_(std::move(stamps)),
+      front_end_(file_, std::move(path), false, errors_stream_, true)
+  {
+    ok_ = front_end_.Run();
+    errors_ = errors_stream_.str();
+    errors_stream_.str({});
+
+    for (util::FileStamp& stamp: front_end_.GetImportStamps())
+    {
+      stamps_.push_back(std::move(stamp));
+    }
+  }
+};
+
+// Programs by the request that loaded them, least recently used dropped
+// first. Programs whose files changed are dropped when next looked up.
+class ProgramCache
+{
+public:
+  static constexpr size_t kCapacity = 64;
+
+  // Null if key is not cached or its files have changed.
+  std::shared_ptr<Program> Find(const std::string& key)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end())
+    {
+      return nullptr;
+    }
+    if (!it->second->second->IsCurrent())
+    {
+      entries_.erase(it->second);
+      index_.erase(it);
+      return nullptr;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->second;
+  }
+
+  void Insert(const std::string& key, std::shared_ptr<Program> program)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end())
+    {
+      entries_.erase(it->second);
+      index_.erase(it);
+    }
+    entries_.emplace_front(key, std::move(program));
+    index_.emplace(key, entries_.begin());
+    if (entries_.size() > kCapacity)
+    {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+  }
+
+private:
+  std::mutex mutex_;
+  // Most recently used first. Running programs are kept alive by their
+  // runs when they are dropped.
+  std::list<std::pair<std::string, std::shared_ptr<Program>>> entries_;
+  std::unordered_map<std::string, std::list<std::pair<std::string, std::shared_ptr<Program>>>::iterator> index_;
+};
+
+} // namespace server
@@ -0,0 +1,307 @@
+#include "server.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string_view>
+#include <thread>
+
+#include "interpreter/interpreter.h"
+#include "vm/compiler.h"
+#include "vm/vm.h"
+
+namespace server
+{
+
+namespace
+{
+
+// Buffered reads and whole writes on a connected socket.
+class Connection
+{
+public:
+  explicit Connection(int fd)
+    : fd_(fd)
+  {}
+
+  // Reads up to a newline, which is dropped. False at the end of the input
+  // or if the line is longer than max_size.
+  bool ReadLine(std::string& line, size_t max_size)
+  {
+    while (true)
+    {
+      size_t end = buffer_.find('\n', begin_);
+      if (end != std::string::npos)
+      {
+        line.assign(buffer_, begin_, end - begin_);
+        begin_ = end + 1;
+        return true;
+      }
+      if (buffer_.size() - begin_ > max_size || !Fill())
+      {
+        return false;
+      }
+    }
+  }
+
+  bool ReadBytes(std::string& bytes, size_t size)
+  {
+    while (buffer_.size() - begin_ < size)
+    {
+      if (!Fill())
+      {
+        return false;
+      }
+    }
+    bytes.assign(buffer_, begin_, size);
+    begin_ += size;
+    return true;
+  }
+
+  bool Write(std::string_view data)
+  {
+    while (!data.empty())
+    {
+      ssize_t n = send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n <= 0)
+      {
+        return false;
+      }
+      data.remove_prefix(n);
+    }
+    return true;
+  }
+
+private:
+  int fd_;
+  std::string buffer_;
+  // Start of the unread part of buffer_.
+  size_t begin_ = 0;
+
+  bool Fill()
+  {
+    buffer_.erase(0, begin_);
+    begin_ = 0;
+    char chunk[1 << 16];
+    ssize_t n;
+    do
+    {
+      n = recv(fd_, chunk, sizeof(chunk), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+    {
+      return false;
+    }
+    buffer_.append(chunk, n);
+    return true;
+  }
+};
+
+int64_t MicrosecondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+Server::~Server()
+{
+  if (listen_fd_ >= 0)
+  {
+    close(listen_fd_);
+    unlink(kSocketPath.c_str());
+  }
+}
+
+bool Server::Run()
+{
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (kSocketPath.size() >= sizeof(address.sun_path))
+  {
+    std::cerr << "Socket path is too long: " << kSocketPath << "\n";
+    return false;
+  }
+  std::strcpy(address.sun_path, kSocketPath.c_str());
+
+  // A socket left behind by a server that did not exit cleanly.
+  struct stat info;
+  if (lstat(kSocketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+  {
+    unlink(kSocketPath.c_str());
+  }
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0 ||
+      bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(listen_fd_, SOMAXCONN) != 0)
+  {
+    std::cerr << "Can not listen on " << kSocketPath << ": " << std::strerror(errno) << "\n";
+    if (listen_fd_ >= 0)
+    {
+      close(listen_fd_);
+      listen_fd_ = -1;
+    }
+    return false;
+  }
+
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(connections_mutex_);
+      connection_closed_.wait(lock, [this] { return connections_ < kMaxConnections; });
+    }
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE)
+      {
+        continue;
+      }
+      std::cerr << "Can not accept on " << kSocketPath << ": " << std::strerror(errno) << "\n";
+      return true;
+    }
+    // A thread per connection rather than a pool, since a client may keep
+    // its connection open between requests.
+    {
+      std::lock_guard<std::mutex> lock(connections_mutex_);
+      ++connections_;
+    }
+    std::thread([this, fd] {
+      Serve(fd);
+      close(fd);
+      std::lock_guard<std::mutex> lock(connections_mutex_);
+      --connections_;
+      connection_closed_.notify_one();
+    }).detach();
+  }
+}
+
+void Server::Serve(int fd)
+{
+  Connection connection(fd);
+  std::string line;
+  while (connection.ReadLine(line, kMaxLine))
+  {
+    auto start = std::chrono::steady_clock::now();
+    std::string key;
+    std::string source;
+    bool is_file = line.rfind("RUN ", 0) == 0;
+    if (is_file && line.size() > 4)
+    {
+      std::error_code error;
+      std::filesystem::path path = std::filesystem::absolute(line.substr(4), error);
+      key = "RUN " + path.lexically_normal().string();
+    }
+    else if (line.rfind("EVAL ", 0) == 0)
+    {
+      size_t size = 0;
+      const char* end = line.data() + line.size();
+      auto [ptr, error] = std::from_chars(line.data() + 5, end, size);
+      if (error == std::errc() && ptr == end && size <= kMaxSource && connection.ReadBytes(source, size))
+      {
+        key = "EVAL " + source;
+      }
+    }
+    if (key.empty())
+    {
+      connection.Write("2 0 0 0 0 0\n");
+      return;
+    }
+
+    std::shared_ptr<Program> program = cache_.Find(key);
+    bool cached = program != nullptr;
+    if (!program)
+    {
+      program = is_file ? Program::FromFile(key.substr(4)) : Program::FromSource(std::move(source));
+      if (program)
+      {
+        cache_.Insert(key, program);
+      }
+    }
+    int64_t load_us = MicrosecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    std::string out;
+    std::string err;
+    int status = 1;
+    if (!program)
+    {
+      err = "Can not open " + key.substr(4) + "\n";
+    }
+    else
+    {
+      status = Execute(*program, out, err);
+    }
+    int64_t run_us = MicrosecondsSince(start);
+
+    std::string header = std::to_string(status) + " " + std::to_string(cached) + " " + std::to_string(load_us) +
+                         " " + std::to_string(run_us) + " " + std::to_string(out.size()) + " " +
+                         std::to_string(err.size()) + "\n";
+    if (!connection.Write(header) || !connection.Write(out) || !connection.Write(err))
+    {
+      return;
+    }
+  }
+}
+
+int Server::Execute(Program& program, std::string& out, std::string& err) const
+{
+  if (!program.IsOk())
+  {
+    err = program.GetErrors();
+    return 1;
+  }
+
+  // Engines hold state of one run only, so each run gets its own; the
+  // program they run is shared.
+  frontend::FrontEnd& front_end = program.GetFrontEnd();
+  std::ostringstream out_stream;
+  std::ostringstream err_stream;
+  int status = 0;
+  try
+  {
+    if (kUseVm)
+    {
+      // Compiled per run, since the inline caches in the code are per run.
+      vm::Compiler compiler(front_end.GetResolution());
+      std::shared_ptr<vm::FunctionProto> script = compiler.Compile(front_end.GetProgram().GetStatements());
+      vm::VM vm(program.GetFile(), &front_end, out_stream, err_stream);
+      vm.Interpret(script);
+    }
+    else
+    {
+      interpreter::Interpreter interpreter(program.GetFile(), front_end.GetResolution(), &front_end, out_stream,
+                                           err_stream);
+      interpreter.Interpret(front_end.GetProgram().GetStatements());
+    }
+  }
+  catch (const vm::CompileError& e)
+  {
+    err_stream << "[COMPILER]: " << e.what() << "\n";
+    status = 1;
+  }
+  catch (const std::exception& e)
+  {
+    err_stream << e.what() << "\n";
+  }
+  out = out_stream.str();
+  err = err_stream.str();
+  return status;
+}
+
+} // namespace server
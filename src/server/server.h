@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+#include "program_cache.h"
+
+namespace server
+{
+
+// Runs scripts for clients of a Unix domain socket, so that they do not pay
+// for starting a process, and for the front end when a script is run again.
+// Each connection is served on a thread of its own and may send any number
+// of requests, one after the other. At most kMaxConnections are served at
+// once; further ones wait to be accepted until one of them is closed.
+//
+//   RUN <path>\n            runs the script at path
+//   EVAL <size>\n<source>   runs size bytes of source
+//
+// Each is answered with
+//
+//   <status> <cached> <load us> <run us> <out size> <err size>\n<out><err>
+//
+// where status is 0 if the script ran, 1 if it could not be read or has
+// errors, which are in err, and 2 if the request was malformed, after which
+// the connection is closed. cached is 1 if the front end was skipped. out is
+// what the script printed and err its runtime error, if any.
+//
+// Identifiers are interned into the process-wide symbol table, which is
+// never trimmed, so memory grows with the number of distinct identifiers
+// ever loaded. That is bounded for a fixed set of scripts, but not for a
+// client that keeps sending generated source through EVAL.
+class Server
+{
+public:
+  // use_vm runs the scripts on the VM instead of the tree-walker.
+  Server(std::string socket_path, bool use_vm)
+    : kSocketPath(std::move(socket_path)),
+      kUseVm(use_vm)
+  {}
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  ~Server();
+
+  // Serves until the socket fails. False if it could not be set up, which
+  // has been reported.
+  bool Run();
+
+private:
+  // Longest request line accepted.
+  static constexpr size_t kMaxLine = 4096;
+  // Largest source accepted by EVAL.
+  static constexpr size_t kMaxSource = 64 << 20;
+  // Connections served at once.
+  static constexpr size_t kMaxConnections = 64;
+
+  const std::string kSocketPath;
+  const bool kUseVm;
+  int listen_fd_ = -1;
+  ProgramCache cache_;
+  std::mutex connections_mutex_;
+  std::condition_variable connection_closed_;
+  size_t connections_ = 0;
+
+  // Answers the requests on the connection fd until it is closed.
+  void Serve(int fd);
+
+  // Fills out and err and returns the status of the response.
+  int Execute(Program& program, std::string& out, std::string& err) const;
+};
+
+} // namespace server
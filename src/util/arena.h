@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+// Fixed-size array living in an Arena.
+template <typename T>
+class Span
+{
+public:
+  Span()
+    : data_(nullptr),
+      size_(0)
+  {}
+
+  Span(T* data, size_t size)
+    : data_(data),
+      size_(size)
+  {}
+
+  T* begin() const { return data_; }
+  T* end() const { return data_ + size_; }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  T& operator[](size_t idx) const { return data_[idx]; }
+
+private:
+  T* data_;
+  size_t size_;
+};
+
+// Bump allocator for objects that die together. Trivially destructible
+// objects are released with their block and cost nothing to free; the others
+// have their destructors run when the arena goes away.
+class Arena
+{
+public:
+  Arena() = default;
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  Arena(Arena&&) = default;
+  Arena& operator=(Arena&&) = default;
+
+  ~Arena()
+  {
+    for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it)
+    {
+      it->destroy(it->object);
+    }
+  }
+
+  template <typename T, typename ... Args>
+  T* New(Args&& ... args)
+  {
+    T* obj = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if constexpr (!std::is_trivially_destructible_v<T>)
+    {
+      destructors_.push_back({obj, [](void* ptr) { static_cast<T*>(ptr)->~T(); }});
+    }
+    return obj;
+  }
+
+  template <typename T>
+  Span<T> MakeSpan(const std::vector<T>& items)
+  {
+    static_assert(std::is_trivially_destructible_v<T>, "Span elements are never destroyed.");
+    if (items.empty())
+    {
+      return {};
+    }
+    T* data = static_cast<T*>(Allocate(sizeof(T) * items.size(), alignof(T)));
+    std::uninitialized_copy(items.begin(), items.end(), data);
+    return Span<T>(data, items.size());
+  }
+
+  void* Allocate(size_t size, size_t align)
+  {
+    size_t padding = (align - reinterpret_cast<uintptr_t>(cur_) % align) % align;
+    if (!cur_ || static_cast<size_t>(end_ - cur_) < padding + size)
+    {
+      AddBlock(size + align);
+      padding = (align - reinterpret_cast<uintptr_t>(cur_) % align) % align;
+    }
+    void* result = cur_ + padding;
+    cur_ += padding + size;
+    return result;
+  }
+
+  // Bytes taken from the system so far.
+  size_t GetReserved() const { return reserved_; }
+
+private:
+  static constexpr size_t kMinBlockSize = 1 << 16;
+  static constexpr size_t kMaxBlockSize = 1 << 22;
+
+  struct Destructor
+  {
+    void* object;
+    void (*destroy)(void*);
+  };
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* cur_ = nullptr;
+  char* end_ = nullptr;
+  size_t reserved_ = 0;
+  std::vector<Destructor> destructors_;
+
+  void AddBlock(size_t min_size)
+  {
+    // Blocks grow with the arena so that small trees stay small and large
+    // ones need few blocks.
+    size_t size = std::max(min_size, std::clamp(reserved_, kMinBlockSize, kMaxBlockSize));
+    blocks_.emplace_back(new char[size]);
+    cur_ = blocks_.back().get();
+    end_ = cur_ + size;
+    reserved_ += size;
+  }
+};
+
+} // util
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+// A problem found in a source file before it runs.
+struct Diagnostic
+{
+  // Front end stage that found it, e.g. "PARSER".
+  const char* stage;
+  size_t line;
+  size_t column;
+  std::string message;
+};
+
+// Diagnostics of one source file, in the order they were found. The stages
+// of the front end record problems here and carry on, so that one pass over
+// a broken script reports everything that is wrong with it.
+class Diagnostics
+{
+public:
+  void Report(const char* stage, std::pair<size_t, size_t> pos, std::string message)
+  {
+    diagnostics_.push_back({stage, pos.first, pos.second, std::move(message)});
+  }
+
+  bool Empty() const { return diagnostics_.empty(); }
+
+  size_t Size() const { return diagnostics_.size(); }
+
+  const Diagnostic& operator[](size_t i) const { return diagnostics_[i]; }
+
+  // Writes the diagnostics from the one at begin on, one per line as
+  // "[STAGE]:line:column: message". A non-empty path goes before the line.
+  void Print(std::ostream& out, size_t begin = 0, const std::string& path = "") const
+  {
+    for (size_t i = begin; i < diagnostics_.size(); ++i)
+    {
+      const Diagnostic& d = diagnostics_[i];
+      out << "[" << d.stage << "]:";
+      if (!path.empty())
+      {
+        out << path << ":";
+      }
+      out << d.line << ":" << d.column << ": " << d.message << "\n";
+    }
+  }
+
+private:
+  std::vector<Diagnostic> diagnostics_;
+};
+
+} // util
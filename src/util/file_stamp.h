@@ -0,0 +1,39 @@
+#pragma once
+
+#include <sys/stat.h>
+
+#include <string>
+#include <utility>
+
+namespace util {
+
+// Size and modification time of a file, to tell later whether it has
+// changed. Take one before reading the file, so that a change made while it
+// is read shows too. A missing file has size -1.
+struct FileStamp
+{
+  std::string path;
+  off_t size = -1;
+  struct timespec mtime = {};
+
+  static FileStamp Take(std::string path)
+  {
+    FileStamp stamp;
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0)
+    {
+      stamp.size = info.st_size;
+      stamp.mtime = info.st_mtim;
+    }
+    stamp.path = std::move(path);
+    return stamp;
+  }
+
+  bool IsCurrent() const
+  {
+    FileStamp now = Take(path);
+    return now.size == size && now.mtime.tv_sec == mtime.tv_sec && now.mtime.tv_nsec == mtime.tv_nsec;
+  }
+};
+
+} // util
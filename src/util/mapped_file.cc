@@ -0,0 +1,70 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace util {
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+bool MappedFile::Open(const char* path)
+{
+  return Load(path, true);
+}
+
+bool MappedFile::Read(const char* path)
+{
+  return Load(path, false);
+}
+
+bool MappedFile::Load(const char* path, bool map)
+{
+  Close();
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  struct stat info;
+  if (map && fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+  {
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED)
+    {
+      madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+      mapping_ = mapping;
+      size_ = info.st_size;
+      close(fd);
+      return true;
+    }
+  }
+
+  char chunk[1 << 16];
+  ssize_t n;
+  while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+  {
+    buffer_.append(chunk, n);
+  }
+  close(fd);
+  return n == 0;
+}
+
+void MappedFile::Close()
+{
+  if (mapping_)
+  {
+    munmap(mapping_, size_);
+    mapping_ = nullptr;
+    size_ = 0;
+  }
+  buffer_.clear();
+}
+
+} // util
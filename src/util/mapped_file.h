@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace util {
+
+// Read-only contents of a file. Regular files are mapped into memory, other
+// inputs (pipes, terminals) are read into a buffer.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile();
+
+  // False if path can not be opened or read.
+  bool Open(const char* path);
+
+  // Same, but always reads the file into a buffer, so that the contents stay
+  // as they are if the file is changed or truncated later.
+  bool Read(const char* path);
+
+  // Valid until the file is closed or destroyed.
+  std::string_view GetContents() const
+  {
+    return mapping_ ? std::string_view(static_cast<const char*>(mapping_), size_) : std::string_view(buffer_);
+  }
+
+  void Close();
+
+private:
+  void* mapping_ = nullptr;
+  size_t size_ = 0;
+  std::string buffer_;
+
+  bool Load(const char* path, bool map);
+};
+
+} // util
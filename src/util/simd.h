@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Byte scanning loops used by the scanner. Each function returns the first
+// position in [begin, end) that stops the scan, or end. The vector paths
+// never read past end; the leftover tail goes through the scalar loop.
+namespace util {
+namespace simd {
+
+namespace detail {
+
+inline bool IsSpace(char c)
+{
+  // ' ' and '\t', '\n', '\v', '\f', '\r'.
+  return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+}
+
+inline bool IsStringStop(char c)
+{
+  return c == '"' || c == '\\' || c == '\n';
+}
+
+#if defined(__AVX2__)
+
+constexpr size_t kWidth = 32;
+using Vector = __m256i;
+using Mask = unsigned;
+
+inline Vector Load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline Vector Splat(char c) { return _mm256_set1_epi8(c); }
+inline Vector Equal(Vector a, Vector b) { return _mm256_cmpeq_epi8(a, b); }
+inline Vector Or(Vector a, Vector b) { return _mm256_or_si256(a, b); }
+inline Vector Sub(Vector a, Vector b) { return _mm256_sub_epi8(a, b); }
+inline Vector Min(Vector a, Vector b) { return _mm256_min_epu8(a, b); }
+inline Mask Bits(Vector v) { return static_cast<unsigned>(_mm256_movemask_epi8(v)); }
+constexpr Mask kAllBits = 0xffffffffu;
+
+#elif defined(__SSE2__)
+
+constexpr size_t kWidth = 16;
+using Vector = __m128i;
+using Mask = unsigned;
+
+inline Vector Load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline Vector Splat(char c) { return _mm_set1_epi8(c); }
+inline Vector Equal(Vector a, Vector b) { return _mm_cmpeq_epi8(a, b); }
+inline Vector Or(Vector a, Vector b) { return _mm_or_si128(a, b); }
+inline Vector Sub(Vector a, Vector b) { return _mm_sub_epi8(a, b); }
+inline Vector Min(Vector a, Vector b) { return _mm_min_epu8(a, b); }
+inline Mask Bits(Vector v) { return static_cast<unsigned>(_mm_movemask_epi8(v)); }
+constexpr Mask kAllBits = 0xffffu;
+
+#endif
+
+} // detail
+
+// First character that is not whitespace.
+inline const char* SkipWhitespace(const char* begin, const char* end)
+{
+  const char* p = begin;
+#if defined(__AVX2__) || defined(__SSE2__)
+  using namespace detail;
+  const Vector space = Splat(' ');
+  const Vector tab = Splat('\t');
+  const Vector range = Splat('\r' - '\t');
+  for (; end - p >= static_cast<ptrdiff_t>(kWidth); p += kWidth)
+  {
+    Vector v = Load(p);
+    // Unsigned v - '\t' <= '\r' - '\t' is min(x, range) == x.
+    Vector shifted = Sub(v, tab);
+    Vector is_space = Or(Equal(v, space), Equal(Min(shifted, range), shifted));
+    Mask other = ~Bits(is_space) & kAllBits;
+    if (other)
+    {
+      return p + __builtin_ctz(other);
+    }
+  }
+#endif
+  while (p != end && detail::IsSpace(*p)) { ++p; }
+  return p;
+}
+
+// First '"', '\\' or '\n', the characters that end a run of plain string
+// literal body.
+inline const char* FindStringStop(const char* begin, const char* end)
+{
+  const char* p = begin;
+#if defined(__AVX2__) || defined(__SSE2__)
+  using namespace detail;
+  const Vector quote = Splat('"');
+  const Vector backslash = Splat('\\');
+  const Vector newline = Splat('\n');
+  for (; end - p >= static_cast<ptrdiff_t>(kWidth); p += kWidth)
+  {
+    Vector v = Load(p);
+    Mask stop = Bits(Or(Or(Equal(v, quote), Equal(v, backslash)), Equal(v, newline)));
+    if (stop)
+    {
+      return p + __builtin_ctz(stop);
+    }
+  }
+#endif
+  while (p != end && !detail::IsStringStop(*p)) { ++p; }
+  return p;
+}
+
+// First occurrence of c. The C library's memchr is already vectorized.
+inline const char* FindChar(const char* begin, const char* end, char c)
+{
+  const void* found = std::memchr(begin, c, end - begin);
+  return found ? static_cast<const char*>(found) : end;
+}
+
+} // simd
+} // util
@@ -0,0 +1,39 @@
+#include "source_file.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace util {
+
+std::pair<size_t, size_t> SourceFile::GetPosition(size_t offset) const
+{
+  std::call_once(indexed_, [this] { BuildIndex(); });
+
+  auto next_line = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset);
+  size_t line = next_line - line_starts_.begin();
+  return {line, offset - line_starts_[line - 1] + 1};
+}
+
+void SourceFile::BuildIndex() const
+{
+  line_starts_.push_back(0);
+
+  const char* begin = text_.data();
+  const char* end = begin + text_.size();
+  for (const char* p = begin; ; )
+  {
+    const void* newline = std::memchr(p, '\n', end - p);
+    if (!newline)
+    {
+      break;
+    }
+    p = static_cast<const char*>(newline) + 1;
+    if (p == end)
+    {
+      break;
+    }
+    line_starts_.push_back(p - begin);
+  }
+}
+
+} // util
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+// Text of one input with offset to line/column lookup. The line index is
+// built on the first lookup, so inputs without diagnostics never pay for
+// it; lookups are safe from several threads.
+class SourceFile
+{
+public:
+  // text must outlive the SourceFile.
+  explicit SourceFile(std::string_view text)
+    : text_(text)
+  {}
+
+  SourceFile(const SourceFile&) = delete;
+  SourceFile& operator=(const SourceFile&) = delete;
+
+  std::string_view GetText() const { return text_; }
+
+  // Whether ptr points into the text or just past it.
+  bool Contains(const char* ptr) const
+  {
+    return text_.data() <= ptr && ptr <= text_.data() + text_.size();
+  }
+
+  // 1-based line and column of the character at offset.
+  std::pair<size_t, size_t> GetPosition(size_t offset) const;
+
+  // Same for a pointer into the text.
+  std::pair<size_t, size_t> GetPosition(const char* ptr) const
+  {
+    return GetPosition(static_cast<size_t>(ptr - text_.data()));
+  }
+
+private:
+  std::string_view text_;
+  mutable std::once_flag indexed_;
+  // Offsets of the first character of each line; a final newline does not
+  // start a line.
+  mutable std::vector<size_t> line_starts_;
+
+  void BuildIndex() const;
+};
+
+} // util
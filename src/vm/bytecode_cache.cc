@@ -0,0 +1,340 @@
+#include "bytecode_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include <unistd.h>
+
+#include "common/heap.h"
+#include "common/object.h"
+#include "common/symbol.h"
+#include "util/mapped_file.h"
+
+namespace vm
+{
+
+namespace
+{
+
+constexpr char kMagic[4] = {'I', 'B', 'C', 'F'};
+// Bump whenever the file layout or the instruction set changes.
+constexpr uint32_t kVersion = 6;
+
+struct Header
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t source_size;
+  uint64_t source_hash;
+  // Hash of everything after the header, to reject truncated files.
+  uint64_t payload_hash;
+};
+
+uint64_t Hash(std::string_view data)
+{
+  return std::hash<std::string_view>()(data);
+}
+
+template <typename T>
+void Put(std::string& out, T val)
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+  out.append(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+void PutString(std::string& out, std::string_view str)
+{
+  Put<uint32_t>(out, str.size());
+  out.append(str);
+}
+
+// The Get functions consume from the front of in and return false if it is
+// too short.
+template <typename T>
+bool Get(std::string_view& in, T& val)
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+  if (in.size() < sizeof(T))
+  {
+    return false;
+  }
+  std::memcpy(&val, in.data(), sizeof(T));
+  in.remove_prefix(sizeof(T));
+  return true;
+}
+
+bool GetString(std::string_view& in, std::string_view& str)
+{
+  uint32_t size;
+  if (!Get(in, size) || in.size() < size)
+  {
+    return false;
+  }
+  str = in.substr(0, size);
+  in.remove_prefix(size);
+  return true;
+}
+
+} // namespace
+
+BytecodeCache::BytecodeCache(const util::SourceFile& file, std::string path)
+  : kFile(file),
+    kPath(std::move(path)),
+    kSourceHash(Hash(file.GetText()))
+{}
+
+std::shared_ptr<FunctionProto> BytecodeCache::Load()
+{
+  util::MappedFile cache;
+  if (!cache.Open(kPath.c_str()))
+  {
+    return nullptr;
+  }
+
+  std::string_view in = cache.GetContents();
+  Header header;
+  if (!Get(in, header) ||
+      std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion ||
+      header.source_size != kFile.GetText().size() ||
+      header.source_hash != kSourceHash ||
+      header.payload_hash != Hash(in))
+  {
+    return nullptr;
+  }
+
+  std::shared_ptr<FunctionProto> script = ReadProto(in);
+  return in.empty() ? script : nullptr;
+}
+
+bool BytecodeCache::Store(const FunctionProto& script) const
+{
+  std::string payload;
+  WriteProto(payload, script, kFile.GetText().data());
+
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.source_size = kFile.GetText().size();
+  header.source_hash = kSourceHash;
+  header.payload_hash = Hash(payload);
+
+  std::string tmp_path = kPath + "." + std::to_string(getpid());
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(payload.data(), payload.size());
+    if (!out.flush())
+    {
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), kPath.c_str()) != 0)
+  {
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+void BytecodeCache::WriteProto(std::string& out, const FunctionProto& proto, const char* source)
+{
+  const Chunk& chunk = proto.chunk_;
+
+  PutString(out, common::GetSymbolName(proto.name_));
+  Put<uint32_t>(out, proto.arity_);
+  Put<uint8_t>(out, proto.has_closures_);
+  Put<uint32_t>(out, proto.max_stack_);
+
+  PutString(out, std::string_view(reinterpret_cast<const char*>(chunk.code_.data()), chunk.code_.size()));
+
+  Put<uint32_t>(out, chunk.constants_.size());
+  for (const common::Object& constant: chunk.constants_)
+  {
+    // The compiler only adds the values of number and string literals.
+    Put<uint8_t>(out, constant.GetType());
+    switch (constant.GetType())
+    {
+      case common::Object::INT:
+        Put(out, constant.AsInt());
+        break;
+      case common::Object::FLOAT:
+        Put(out, constant.AsFloat());
+        break;
+      default:
+        PutString(out, constant.AsString());
+    }
+  }
+
+  // Symbols differ between runs, so names are stored as text.
+  Put<uint32_t>(out, chunk.names_.size());
+  for (common::Symbol name: chunk.names_)
+  {
+    PutString(out, common::GetSymbolName(name));
+  }
+
+  Put<uint32_t>(out, chunk.caches_.size());
+
+  // Tokens are stored as their place in the source, which is unchanged when
+  // the cache is used.
+  Put<uint32_t>(out, chunk.tokens_.size());
+  for (const auto& [offset, token]: chunk.tokens_)
+  {
+    Put<uint32_t>(out, offset);
+    Put<uint64_t>(out, token.GetLexeme().data() - source);
+    Put<uint32_t>(out, token.Length());
+    Put<uint8_t>(out, token.GetType());
+  }
+
+  Put<uint32_t>(out, chunk.functions_.size());
+  for (const auto& function: chunk.functions_)
+  {
+    WriteProto(out, *function, source);
+  }
+}
+
+std::shared_ptr<FunctionProto> BytecodeCache::ReadProto(std::string_view& in)
+{
+  auto proto = std::make_shared<FunctionProto>();
+  Chunk& chunk = proto->chunk_;
+
+  std::string_view name;
+  uint32_t arity;
+  uint8_t has_closures;
+  uint32_t max_stack;
+  std::string_view code;
+  if (!GetString(in, name) || !Get(in, arity) || !Get(in, has_closures) || !Get(in, max_stack) ||
+      max_stack > FunctionProto::kMaxStack || !GetString(in, code))
+  {
+    return nullptr;
+  }
+  proto->name_ = common::Intern(name);
+  proto->arity_ = arity;
+  proto->has_closures_ = has_closures;
+  proto->max_stack_ = max_stack;
+  chunk.code_.assign(code.begin(), code.end());
+
+  uint32_t num_constants;
+  if (!Get(in, num_constants))
+  {
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < num_constants; ++i)
+  {
+    uint8_t type;
+    if (!Get(in, type))
+    {
+      return nullptr;
+    }
+    switch (type)
+    {
+      case common::Object::INT:
+      {
+        int64_t val;
+        if (!Get(in, val))
+        {
+          return nullptr;
+        }
+        chunk.AddConstant(common::MakeInt(val));
+        break;
+      }
+      case common::Object::FLOAT:
+      {
+        double val;
+        if (!Get(in, val))
+        {
+          return nullptr;
+        }
+        chunk.AddConstant(common::MakeFloat(val));
+        break;
+      }
+      case common::Object::STRING:
+      {
+        std::string_view val;
+        if (!GetString(in, val))
+        {
+          return nullptr;
+        }
+        // Permanent, like the string literals made by the parser.
+        common::String* string = arena_.New<common::String>(std::string(val));
+        common::Heap::MarkPermanent(string);
+        chunk.AddConstant(common::Object(common::Object::STRING, string));
+        break;
+      }
+      default:
+        return nullptr;
+    }
+  }
+
+  uint32_t num_names;
+  if (!Get(in, num_names))
+  {
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < num_names; ++i)
+  {
+    std::string_view name;
+    if (!GetString(in, name))
+    {
+      return nullptr;
+    }
+    chunk.AddName(common::Intern(name));
+  }
+
+  uint32_t num_caches;
+  if (!Get(in, num_caches))
+  {
+    return nullptr;
+  }
+  chunk.caches_.resize(num_caches);
+
+  uint32_t num_tokens;
+  if (!Get(in, num_tokens))
+  {
+    return nullptr;
+  }
+  std::string_view source = kFile.GetText();
+  for (uint32_t i = 0; i < num_tokens; ++i)
+  {
+    uint32_t offset;
+    uint64_t begin;
+    uint32_t size;
+    uint8_t type;
+    if (!Get(in, offset) || !Get(in, begin) || !Get(in, size) || !Get(in, type) ||
+        begin > source.size() || size > source.size() - begin || size > scanner::Token::kMaxSize ||
+        type > scanner::Token::BAD_TOKEN)
+    {
+      return nullptr;
+    }
+    // Only the text of the token is used, for error messages, so literals
+    // do not get their payload back.
+    auto token_type = static_cast<scanner::Token::Type>(type);
+    std::string_view lexeme = source.substr(begin, size);
+    uint32_t payload = token_type == scanner::Token::IDENTIFIER ? common::Intern(lexeme) : 0;
+    chunk.tokens_[offset] = scanner::Token(token_type, lexeme.data(), size, payload);
+  }
+
+  uint32_t num_functions;
+  if (!Get(in, num_functions))
+  {
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < num_functions; ++i)
+  {
+    std::shared_ptr<FunctionProto> function = ReadProto(in);
+    if (!function)
+    {
+      return nullptr;
+    }
+    chunk.AddFunction(std::move(function));
+  }
+
+  return proto;
+}
+
+} // namespace vm
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "chunk.h"
+#include "util/arena.h"
+#include "util/source_file.h"
+
+namespace vm
+{
+
+// Compiled scripts kept on disk so that later runs of an unchanged script
+// skip scanning, parsing, resolution and compilation. A cache file records
+// the size and hash of the source it was compiled from and is ignored when
+// they do not match. Files use the host byte order and are not meant to move
+// between machines.
+class BytecodeCache
+{
+public:
+  // path is where the cache of file is kept.
+  BytecodeCache(const util::SourceFile& file, std::string path);
+
+  BytecodeCache(const BytecodeCache&) = delete;
+  BytecodeCache& operator=(const BytecodeCache&) = delete;
+
+  // The cached script, nullptr if there is no valid cache for the source.
+  // The script must not outlive the BytecodeCache, which owns its strings.
+  std::shared_ptr<FunctionProto> Load();
+
+  // Replaces the cache file with script, atomically so that concurrent runs
+  // never see a partial file. False if it could not be written.
+  bool Store(const FunctionProto& script) const;
+
+private:
+  const util::SourceFile& kFile;
+  const std::string kPath;
+  const uint64_t kSourceHash;
+  // String constants of loaded scripts.
+  util::Arena arena_;
+
+  static void WriteProto(std::string& out, const FunctionProto& proto, const char* source);
+
+  std::shared_ptr<FunctionProto> ReadProto(std::string_view& in);
+};
+
+} // namespace vm
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/object.h"
+#include "common/symbol.h"
+#include "interpreter/inline_cache.h"
+#include "scanner/token.h"
+#include "opcode.h"
+
+namespace parser
+{
+namespace stmt
+{
+
+class Func;
+
+} // namespace stmt
+} // namespace parser
+
+namespace vm
+{
+
+struct FunctionProto;
+class BytecodeCache;
+
+// A program that does not fit into the bytecode or the VM, e.g. one with
+// more than 2^16 functions in one scope.
+class CompileError: public std::runtime_error
+{
+public:
+  using std::runtime_error::runtime_error;
+};
+
+class Chunk
+{
+public:
+  size_t Emit(Op op)
+  {
+    code_.push_back(static_cast<uint8_t>(op));
+    return code_.size() - 1;
+  }
+
+  size_t Emit(Op op, const scanner::Token& token)
+  {
+    size_t offset = Emit(op);
+    tokens_[offset] = token;
+    return offset;
+  }
+
+  void EmitU8(size_t val)
+  {
+    if (val > UINT8_MAX)
+    {
+      throw CompileError("Bytecode operand does not fit into u8.");
+    }
+    code_.push_back(static_cast<uint8_t>(val));
+  }
+
+  void EmitU16(size_t val)
+  {
+    if (val > UINT16_MAX)
+    {
+      throw CompileError("Bytecode operand does not fit into u16.");
+    }
+    code_.push_back(static_cast<uint8_t>(val & 0xff));
+    code_.push_back(static_cast<uint8_t>(val >> 8));
+  }
+
+  void EmitU32(size_t val)
+  {
+    code_.resize(code_.size() + 4);
+    PatchU32(code_.size() - 4, val);
+  }
+
+  void PatchU32(size_t offset, size_t val)
+  {
+    if (val > UINT32_MAX)
+    {
+      throw CompileError("Bytecode operand does not fit into u32.");
+    }
+    for (size_t i = 0; i < 4; ++i)
+    {
+      code_[offset + i] = static_cast<uint8_t>(val >> (8 * i));
+    }
+  }
+
+  // Equal constants share an index.
+  size_t AddConstant(common::Object obj)
+  {
+    std::string key = GetConstantKey(obj);
+    auto it = constant_ids_.find(key);
+    if (it != constant_ids_.end())
+    {
+      return it->second;
+    }
+    constants_.push_back(obj);
+    return constant_ids_[std::move(key)] = constants_.size() - 1;
+  }
+
+  size_t AddName(common::Symbol name)
+  {
+    auto it = name_ids_.find(name);
+    if (it != name_ids_.end())
+    {
+      return it->second;
+    }
+    names_.push_back(name);
+    return name_ids_[name] = names_.size() - 1;
+  }
+
+  size_t AddCache()
+  {
+    caches_.emplace_back();
+    return caches_.size() - 1;
+  }
+
+  size_t AddFunction(std::shared_ptr<FunctionProto> function)
+  {
+    functions_.push_back(function);
+    return functions_.size() - 1;
+  }
+
+  size_t Size() const { return code_.size(); }
+
+  const uint8_t* GetCode() const { return code_.data(); }
+
+  const common::Object& GetConstant(size_t idx) const { return constants_[idx]; }
+
+  common::Symbol GetName(size_t idx) const { return names_[idx]; }
+
+  const std::shared_ptr<FunctionProto>& GetFunction(size_t idx) const { return functions_[idx]; }
+
+  // Caches are runtime state attached to the code, hence writable through a
+  // const chunk.
+  interpreter::InlineCache& GetCache(size_t idx) const { return caches_[idx]; }
+
+  // Source token of the instruction at offset, used for error messages only.
+  const scanner::Token* FindToken(size_t offset) const
+  {
+    auto it = tokens_.find(offset);
+    return it != tokens_.end() ? &it->second : nullptr;
+  }
+
+private:
+  // Saves and restores chunks as they are.
+  friend class BytecodeCache;
+
+  std::vector<uint8_t> code_;
+  std::vector<common::Object> constants_;
+  std::unordered_map<std::string, size_t> constant_ids_;
+  std::vector<common::Symbol> names_;
+  std::unordered_map<common::Symbol, size_t> name_ids_;
+  std::vector<std::shared_ptr<FunctionProto>> functions_;
+  mutable std::vector<interpreter::InlineCache> caches_;
+  std::unordered_map<size_t, scanner::Token> tokens_;
+
+  // The type and the bytes of a number or string constant, so that 1 and
+  // 1.0 stay apart.
+  static std::string GetConstantKey(const common::Object& obj)
+  {
+    std::string key(1, static_cast<char>(obj.GetType()));
+    switch (obj.GetType())
+    {
+      case common::Object::INT:
+      {
+        int64_t val = obj.AsInt();
+        key.append(reinterpret_cast<const char*>(&val), sizeof(val));
+        break;
+      }
+      case common::Object::FLOAT:
+      {
+        double val = obj.AsFloat();
+        key.append(reinterpret_cast<const char*>(&val), sizeof(val));
+        break;
+      }
+      default:
+        key += obj.AsString();
+    }
+    return key;
+  }
+};
+
+struct FunctionProto
+{
+  // Values the stack of the VM holds, for all frames together.
+  static constexpr size_t kMaxStack = 1 << 16;
+
+  common::Symbol name_;
+  size_t arity_;
+  // See parser::stmt::Func::kHasClosures.
+  bool has_closures_;
+  // Most values the body has on the stack at once; the VM checks there is
+  // room for them before it enters a call.
+  size_t max_stack_ = 0;
+  Chunk chunk_;
+  // Set while the body is not compiled because a lazy parse skipped it; the
+  // VM compiles it on the first call.
+  const parser::stmt::Func* skipped_ = nullptr;
+};
+
+} // namespace vm
@@ -0,0 +1,443 @@
+#pragma once
+
+#include <algorithm>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+#include "parser/expr.h"
+#include "parser/stmt.h"
+#include "resolver/resolution.h"
+#include "chunk.h"
+
+namespace vm
+{
+
+// Compiles resolved statements into bytecode. Variables are addressed by the
+// same (depth, slot) pairs the tree-walking interpreter uses, so the VM keeps
+// one interpreter::Environment per scope.
+class Compiler: public parser::IVisitor,
+                public parser::stmt::IStmtVisitor
+{
+public:
+  Compiler(const resolver::Resolution& resolution)
+    : resolution_(resolution),
+      chunk_(nullptr)
+  {}
+
+  std::shared_ptr<FunctionProto> Compile(util::Span<parser::stmt::Stmt*> stmts)
+  {
+    auto script = std::make_shared<FunctionProto>();
+    script->name_ = common::Intern("script");
+    script->arity_ = 0;
+    script->has_closures_ = true;
+
+    chunk_ = &script->chunk_;
+    depth_ = 0;
+    max_depth_ = 0;
+    for (const auto& s: stmts)
+    {
+      Compile(*s);
+    }
+    chunk_->Emit(Op::NONE);
+    chunk_->Emit(Op::RETURN);
+    chunk_ = nullptr;
+    SetMaxStack(*script);
+
+    return script;
+  }
+
+  // Fills the chunk of proto, the prototype of func. Used directly for
+  // bodies that a lazy parse skipped, once they are loaded.
+  void CompileBody(const parser::stmt::Func& func, FunctionProto& proto)
+  {
+    Chunk* enclosing = chunk_;
+    size_t enclosing_depth = depth_;
+    size_t enclosing_max_depth = max_depth_;
+    chunk_ = &proto.chunk_;
+    depth_ = 0;
+    max_depth_ = 0;
+    for (const auto& s: func.body_)
+    {
+      Compile(*s);
+    }
+    chunk_->Emit(Op::NONE);
+    chunk_->Emit(Op::RETURN);
+    SetMaxStack(proto);
+    chunk_ = enclosing;
+    depth_ = enclosing_depth;
+    max_depth_ = enclosing_max_depth;
+  }
+
+private:
+  const resolver::Resolution& resolution_;
+  Chunk* chunk_;
+  // Values on the stack at the point of the chunk being compiled, and the
+  // most there have been so far, see FunctionProto::max_stack_.
+  size_t depth_ = 0;
+  size_t max_depth_ = 0;
+  // Links of the operator chains being compiled, see CompileChain().
+  std::vector<const parser::Expr*> chain_;
+
+  void Visit(const parser::stmt::Return& stmt) override
+  {
+    if (stmt.value_)
+    {
+      Compile(*stmt.value_);
+    }
+    else
+    {
+      chunk_->Emit(Op::NONE);
+    }
+    chunk_->Emit(Op::RETURN);
+  }
+
+  void Visit(const parser::stmt::Block& stmt) override
+  {
+    chunk_->Emit(Op::PUSH_ENV);
+    chunk_->EmitU8(!stmt.kHasClosures);
+    for (const auto& s: stmt.statements_)
+    {
+      Compile(*s);
+    }
+    chunk_->Emit(Op::POP_ENV);
+    chunk_->EmitU8(!stmt.kHasClosures);
+  }
+
+  void Visit(const parser::stmt::Func& stmt) override
+  {
+    chunk_->Emit(Op::FUNCTION);
+    chunk_->EmitU16(chunk_->AddFunction(CompileFunction(stmt)));
+    chunk_->Emit(Op::DEFINE);
+  }
+
+  void Visit(const parser::stmt::Class& stmt) override
+  {
+    if (stmt.super_)
+    {
+      Compile(*stmt.super_);
+    }
+
+    std::vector<size_t> methods;
+    for (const auto& m: stmt.methods_)
+    {
+      methods.push_back(chunk_->AddFunction(CompileFunction(*m)));
+    }
+
+    chunk_->Emit(Op::CLASS);
+    chunk_->EmitU32(chunk_->AddName(stmt.name_.GetSymbol()));
+    chunk_->EmitU8(stmt.super_ ? 1 : 0);
+    chunk_->EmitU16(methods.size());
+    for (size_t m: methods)
+    {
+      chunk_->EmitU16(m);
+    }
+  }
+
+  void Visit(const parser::stmt::If& stmt) override
+  {
+    Compile(*stmt.condition_);
+    size_t else_jump = EmitJump(Op::JUMP_IF_FALSE);
+    chunk_->Emit(Op::POP);
+    Compile(*stmt.stmt_true_);
+    size_t end_jump = EmitJump(Op::JUMP);
+
+    PatchJump(else_jump);
+    chunk_->Emit(Op::POP);
+    if (stmt.stmt_false_)
+    {
+      Compile(*stmt.stmt_false_);
+    }
+    PatchJump(end_jump);
+  }
+
+  void Visit(const parser::stmt::Expression& stmt) override
+  {
+    Compile(*stmt.expr_);
+    chunk_->Emit(Op::POP);
+  }
+
+  void Visit(const parser::stmt::Print& stmt) override
+  {
+    Compile(*stmt.expr_);
+    chunk_->Emit(Op::PRINT);
+  }
+
+  void Visit(const parser::stmt::While& stmt) override
+  {
+    size_t loop_start = chunk_->Size();
+    Compile(*stmt.condition_);
+    size_t exit_jump = EmitJump(Op::JUMP_IF_FALSE);
+    chunk_->Emit(Op::POP);
+    Compile(*stmt.body_);
+
+    chunk_->Emit(Op::LOOP);
+    chunk_->EmitU32(chunk_->Size() + 4 - loop_start);
+
+    PatchJump(exit_jump);
+    chunk_->Emit(Op::POP);
+  }
+
+  void Visit(const parser::stmt::Var& stmt) override
+  {
+    if (stmt.expr_)
+    {
+      Compile(*stmt.expr_);
+    }
+    else
+    {
+      chunk_->Emit(Op::NONE);
+    }
+    chunk_->Emit(Op::DEFINE);
+  }
+
+  void Visit(const parser::stmt::Import& stmt) override
+  {
+    chunk_->Emit(Op::IMPORT, stmt.name_);
+    chunk_->EmitU16(stmt.module_);
+    chunk_->Emit(Op::DEFINE);
+  }
+
+  void Visit(const parser::This& expr) override
+  {
+    EmitVariable(Op::GET_VAR, expr, expr.name_);
+  }
+
+  void Visit(const parser::Super& expr) override
+  {
+    const resolver::Location* location = resolution_.Find(expr.kId);
+    if (!location)
+    {
+      EmitUnresolved(expr.name_);
+      return;
+    }
+    EmitWithOperands(Op::GET_SUPER, Op::GET_SUPER_WIDE,
+                     {location->depth, chunk_->AddName(expr.method_.GetSymbol()), chunk_->AddCache()});
+  }
+
+  void Visit(const parser::Get& expr) override
+  {
+    Compile(*expr.object_);
+    EmitWithOperands(Op::GET_PROPERTY, Op::GET_PROPERTY_WIDE,
+                     {chunk_->AddName(expr.name_.GetSymbol()), chunk_->AddCache()});
+  }
+
+  void Visit(const parser::Set& expr) override
+  {
+    Compile(*expr.object_);
+    Compile(*expr.value_);
+    EmitWithOperands(Op::SET_PROPERTY, Op::SET_PROPERTY_WIDE,
+                     {chunk_->AddName(expr.name_.GetSymbol()), chunk_->AddCache()});
+  }
+
+  void Visit(const parser::Assign& expr) override
+  {
+    Compile(*expr.value_);
+    EmitVariable(Op::SET_VAR, expr, expr.name_);
+  }
+
+  void Visit(const parser::Literal& expr) override
+  {
+    switch (expr.val_.GetType())
+    {
+      case common::Object::NONE:
+        chunk_->Emit(Op::NONE);
+        return;
+      case common::Object::BOOLEAN:
+        chunk_->Emit(expr.val_.AsBool() ? Op::TRUE : Op::FALSE);
+        return;
+      default:
+        EmitWithOperands(Op::CONSTANT, Op::CONSTANT_WIDE, {chunk_->AddConstant(expr.val_)});
+    }
+  }
+
+  void Visit(const parser::Grouping& expr) override
+  {
+    Compile(*expr.expr_);
+  }
+
+  void Visit(const parser::Unary& expr) override
+  {
+    Compile(*expr.right_);
+    switch (expr.op_.GetType())
+    {
+      case scanner::Token::MINUS:
+        chunk_->Emit(Op::NEGATE, expr.op_);
+        return;
+      case scanner::Token::BANG:
+        chunk_->Emit(Op::NOT);
+        return;
+      default:
+        throw std::logic_error("Bad unary type.");
+    }
+  }
+
+  void Visit(const parser::Logical& expr) override
+  {
+    CompileChain(expr);
+  }
+
+  void Visit(const parser::Binary& expr) override
+  {
+    CompileChain(expr);
+  }
+
+  // Compiles a chain of Binary and Logical operators, see
+  // parser::CollectLeftChain(), from its leftmost operand up in a loop.
+  void CompileChain(const parser::Expr& expr)
+  {
+    size_t base = chain_.size();
+    size_t depth = depth_;
+    Compile(*parser::CollectLeftChain(expr, chain_));
+    while (chain_.size() > base)
+    {
+      const parser::Expr* link = chain_.back();
+      chain_.pop_back();
+      if (auto logical = dynamic_cast<const parser::Logical*>(link))
+      {
+        bool is_or = logical->op_.GetType() == scanner::Token::OR;
+        size_t end_jump = EmitJump(is_or ? Op::JUMP_IF_TRUE : Op::JUMP_IF_FALSE);
+        chunk_->Emit(Op::POP);
+        Compile(*logical->right_);
+        PatchJump(end_jump);
+      }
+      else
+      {
+        const auto& binary = static_cast<const parser::Binary&>(*link);
+        Compile(*binary.right_);
+        chunk_->Emit(GetBinaryOp(binary.kOp), binary.op_);
+      }
+      // Each link leaves one value in place of its operands.
+      depth_ = depth + 1;
+    }
+  }
+
+  void Visit(const parser::Variable& expr) override
+  {
+    EmitVariable(Op::GET_VAR, expr, expr.name_);
+  }
+
+  void Visit(const parser::Call& expr) override
+  {
+    Compile(*expr.callee_);
+    for (const auto& arg: expr.args_)
+    {
+      Compile(*arg);
+    }
+    chunk_->Emit(Op::CALL, expr.paren_);
+    chunk_->EmitU8(expr.args_.size());
+  }
+
+  // Statements leave the stack as they found it. Some push a value of their
+  // own, like the NONE of "return;".
+  void Compile(const parser::stmt::Stmt& stmt)
+  {
+    size_t depth = depth_;
+    max_depth_ = std::max(max_depth_, depth + 1);
+    stmt.Accept(*this);
+    depth_ = depth;
+  }
+
+  // Expressions leave one value, whatever they push and pop on the way.
+  void Compile(const parser::Expr& expr)
+  {
+    size_t depth = depth_;
+    expr.Accept(*this);
+    depth_ = depth + 1;
+    max_depth_ = std::max(max_depth_, depth_);
+  }
+
+  void SetMaxStack(FunctionProto& proto) const
+  {
+    if (max_depth_ > FunctionProto::kMaxStack)
+    {
+      throw CompileError("Function needs more stack than the VM has.");
+    }
+    proto.max_stack_ = max_depth_;
+  }
+
+  std::shared_ptr<FunctionProto> CompileFunction(const parser::stmt::Func& func)
+  {
+    auto proto = std::make_shared<FunctionProto>();
+    proto->name_ = func.name_.GetSymbol();
+    proto->arity_ = func.params_.size();
+    proto->has_closures_ = func.kHasClosures;
+
+    if (func.skipped_)
+    {
+      proto->skipped_ = &func;
+      return proto;
+    }
+    CompileBody(func, *proto);
+    return proto;
+  }
+
+  void EmitVariable(Op op, const parser::Expr& expr, const scanner::Token& name)
+  {
+    const resolver::Location* location = resolution_.Find(expr.kId);
+    if (!location)
+    {
+      EmitUnresolved(name);
+      return;
+    }
+    EmitWithOperands(op, op == Op::GET_VAR ? Op::GET_VAR_WIDE : Op::SET_VAR_WIDE,
+                     {location->depth, location->slot});
+  }
+
+  void EmitUnresolved(const scanner::Token& name)
+  {
+    chunk_->Emit(Op::UNRESOLVED);
+    chunk_->EmitU32(chunk_->AddName(name.GetSymbol()));
+  }
+
+  // Emits op with u16 operands, or wide_op with u32 ones if any of them does
+  // not fit into u16.
+  void EmitWithOperands(Op op, Op wide_op, std::initializer_list<size_t> operands)
+  {
+    bool wide = std::any_of(operands.begin(), operands.end(), [](size_t operand) { return operand > UINT16_MAX; });
+    chunk_->Emit(wide ? wide_op : op);
+    for (size_t operand: operands)
+    {
+      if (wide)
+      {
+        chunk_->EmitU32(operand);
+      }
+      else
+      {
+        chunk_->EmitU16(operand);
+      }
+    }
+  }
+
+  size_t EmitJump(Op op)
+  {
+    chunk_->Emit(op);
+    chunk_->EmitU32(0);
+    return chunk_->Size() - 4;
+  }
+
+  void PatchJump(size_t operand)
+  {
+    chunk_->PatchU32(operand, chunk_->Size() - operand - 4);
+  }
+
+  static Op GetBinaryOp(parser::BinaryOp op)
+  {
+    switch (op)
+    {
+      case parser::BinaryOp::EQUAL: return Op::EQUAL;
+      case parser::BinaryOp::NOT_EQUAL: return Op::NOT_EQUAL;
+      case parser::BinaryOp::GREATER: return Op::GREATER;
+      case parser::BinaryOp::GREATER_EQUAL: return Op::GREATER_EQUAL;
+      case parser::BinaryOp::LESS: return Op::LESS;
+      case parser::BinaryOp::LESS_EQUAL: return Op::LESS_EQUAL;
+      case parser::BinaryOp::ADD: return Op::ADD;
+      case parser::BinaryOp::SUBTRACT: return Op::SUBTRACT;
+      case parser::BinaryOp::MULTIPLY: return Op::MULTIPLY;
+      case parser::BinaryOp::DIVIDE: return Op::DIVIDE;
+    }
+    throw std::logic_error("Bad binary type.");
+  }
+};
+
+} // namespace vm
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Operands follow the opcode byte; u16 and u32 operands are little-endian.
+// The _WIDE variants are emitted where an operand does not fit into u16.
+#define INTERP_FORALL_OPCODES(_) \
+  /* Stack. */ \
+  _(CONSTANT)      /* u16 constant */ \
+  _(CONSTANT_WIDE) /* u32 constant */ \
+  _(NONE) \
+  _(TRUE) \
+  _(FALSE) \
+  _(POP) \
+  /* Variables. */ \
+  _(DEFINE) \
+  _(GET_VAR)       /* u16 depth, u16 slot */ \
+  _(SET_VAR)       /* u16 depth, u16 slot */ \
+  _(GET_VAR_WIDE)  /* u32 depth, u32 slot */ \
+  _(SET_VAR_WIDE)  /* u32 depth, u32 slot */ \
+  _(UNRESOLVED)    /* u32 name */ \
+  /* Properties. */ \
+  _(GET_PROPERTY)  /* u16 name, u16 cache */ \
+  _(SET_PROPERTY)  /* u16 name, u16 cache */ \
+  _(GET_SUPER)     /* u16 depth, u16 name, u16 cache */ \
+  _(GET_PROPERTY_WIDE) /* u32 name, u32 cache */ \
+  _(SET_PROPERTY_WIDE) /* u32 name, u32 cache */ \
+  _(GET_SUPER_WIDE)    /* u32 depth, u32 name, u32 cache */ \
+  /* Operators. */ \
+  _(EQUAL) \
+  _(NOT_EQUAL) \
+  _(GREATER) \
+  _(GREATER_EQUAL) \
+  _(LESS) \
+  _(LESS_EQUAL) \
+  _(ADD) \
+  _(SUBTRACT) \
+  _(MULTIPLY) \
+  _(DIVIDE) \
+  _(NOT) \
+  _(NEGATE) \
+  /* Control flow. */ \
+  _(JUMP)          /* u32 forward offset */ \
+  _(JUMP_IF_FALSE) /* u32 forward offset, keeps the condition */ \
+  _(JUMP_IF_TRUE)  /* u32 forward offset, keeps the condition */ \
+  _(LOOP)          /* u32 backward offset */ \
+  _(CALL)          /* u8 argument count */ \
+  _(RETURN) \
+  /* Declarations. */ \
+  _(FUNCTION)      /* u16 function */ \
+  _(CLASS)         /* u32 name, u8 has super, u16 method count, u16 function per method */ \
+  _(IMPORT)        /* u16 module */ \
+  _(PUSH_ENV)      /* u8 pooled */ \
+  _(POP_ENV)       /* u8 pooled */ \
+  _(PRINT)
+
+namespace vm
+{
+
+enum class Op: uint8_t
+{
+#define INTERP_PUT_WITH_COMMA(_) _,
+  INTERP_FORALL_OPCODES(INTERP_PUT_WITH_COMMA)
+#undef INTERP_PUT_WITH_COMMA
+};
+
+inline std::string GetOpName(Op op)
+{
+  switch (op)
+  {
+#define INTERP_PUT_OP_NAME(_) case Op::_: { return #_; }
+    INTERP_FORALL_OPCODES(INTERP_PUT_OP_NAME)
+#undef INTERP_PUT_OP_NAME
+  }
+  return "BAD OP!";
+}
+
+} // namespace vm
@@ -0,0 +1,643 @@
+#include "vm.h"
+
+#include <iostream>
+
+#include "interpreter/builtin/functions.h"
+#include "interpreter/class_impl.h"
+#include "interpreter/interpret_error.h"
+#include "interpreter/operators.h"
+#include "compiler.h"
+
+// Labels-as-values dispatch is a GNU extension; fall back to a switch.
+#if defined(__GNUC__)
+#define INTERP_VM_COMPUTED_GOTO 1
+#else
+#define INTERP_VM_COMPUTED_GOTO 0
+#endif
+
+namespace vm
+{
+
+common::Object Closure::Call(std::vector<common::Object>& args) const
+{
+  return vm_.Call(*this, args);
+}
+
+common::ICallable* Closure::Bind(common::Object instance) const
+{
+  common::Heap& heap = vm_.GetHeap();
+  auto wrapper = heap.Allocate<interpreter::Environment>(env_);
+  wrapper->Define(instance, heap);
+  return heap.Allocate<Closure>(vm_, proto_, wrapper);
+}
+
+VM::VM(const util::SourceFile& file,
+       resolver::IModuleLoader* loader,
+       std::ostream& out,
+       std::ostream& err)
+  : kFile(file),
+    loader_(loader),
+    out_(out),
+    err_(err),
+    heap_([this](common::Heap& heap) { TraceRoots(heap); }),
+    stack_(kStackSize),
+    sp_(stack_.data()),
+    globals_(heap_.Allocate<interpreter::Environment>())
+{
+  frames_.reserve(kMaxFrames);
+  DefineBuiltins(*globals_);
+}
+
+void VM::DefineBuiltins(interpreter::Environment& globals)
+{
+  // Keep in sync with the global slots declared by resolver::Resolver.
+  globals.Define(common::MakeCallable(heap_.Allocate<interpreter::builtin::functions::ClockBuiltin>()), heap_);
+  globals.Define(common::MakeCallable(heap_.Allocate<interpreter::builtin::functions::PrintBuiltin>(out_)), heap_);
+}
+
+void VM::TraceRoots(common::Heap& heap)
+{
+  for (const common::Object* obj = stack_.data(); obj != sp_; ++obj)
+  {
+    heap.Mark(*obj);
+  }
+  for (const Frame& frame: frames_)
+  {
+    heap.Mark(frame.env);
+  }
+  heap.Mark(globals_);
+  pool_.Trace(heap);
+  modules_.Trace(heap);
+}
+
+void VM::Interpret(std::shared_ptr<const FunctionProto> script)
+{
+  try
+  {
+    frames_.push_back({script.get(), script->chunk_.GetCode(), sp_, globals_, pool_.Size()});
+    Run(0);
+    Pop();
+  }
+  catch (const interpreter::InterpretError& e)
+  {
+    err_ << e.Format(GetFile(e.GetToken())) << '\n';
+    Reset();
+  }
+  catch (const CompileError& e)
+  {
+    // From a module or a lazy body compiled as the script runs.
+    err_ << "[COMPILER]: " << e.what() << '\n';
+    Reset();
+  }
+}
+
+void VM::Reset()
+{
+  frames_.clear();
+  pool_.Truncate(0);
+  sp_ = stack_.data();
+}
+
+common::Object VM::Call(const Closure& closure, std::vector<common::Object>& args)
+{
+  if (GetStackRoom() < args.size() + 1)
+  {
+    // The calling frame saved the ip after the CALL of the native code.
+    Fail(frames_.back().ip - kCallSize, "Stack overflow.");
+  }
+  Push(common::MakeNone());
+  for (auto& arg: args)
+  {
+    Push(arg);
+  }
+  size_t exit_depth = frames_.size();
+  PushFrame(closure, args.size());
+  Run(exit_depth);
+  return Pop();
+}
+
+void VM::PushFrame(const Closure& closure, size_t argc)
+{
+  if (frames_.size() == kMaxFrames)
+  {
+    // The calling frame saved the ip after its CALL instruction.
+    Fail(frames_.back().ip - kCallSize, "Stack overflow.");
+  }
+
+  const FunctionProto& proto = closure.GetProto();
+  if (proto.skipped_)
+  {
+    Load(proto);
+  }
+
+  // The arguments move into the environment, which leaves the frame the
+  // stack above the callee, whose slot takes the result.
+  common::Object* base = sp_ - argc - 1;
+  if (GetStackRoom() + argc < proto.max_stack_)
+  {
+    Fail(frames_.back().ip - kCallSize, "Stack overflow.");
+  }
+  size_t pool_base = pool_.Size();
+  interpreter::Environment* env = proto.has_closures_
+    ? heap_.Allocate<interpreter::Environment>(closure.GetEnv())
+    : pool_.Push(closure.GetEnv());
+  for (size_t i = 1; i <= argc; ++i)
+  {
+    env->Define(std::move(base[i]), heap_);
+  }
+  sp_ = base + 1;
+
+  frames_.push_back({&proto, proto.chunk_.GetCode(), base, env, pool_base});
+}
+
+void VM::Load(const FunctionProto& proto)
+{
+  const parser::stmt::Func& func = *proto.skipped_;
+  if (!loader_ || !loader_->Load(func))
+  {
+    throw interpreter::InterpretError(func.name_, "Can not load function \"" + func.name_.ToRawString() + "\".");
+  }
+
+  // Compilers create protos non-const; this one is completed in place so
+  // that every closure sharing it sees the code.
+  FunctionProto& target = const_cast<FunctionProto&>(proto);
+  Compiler(loader_->GetResolution()).CompileBody(func, target);
+  target.skipped_ = nullptr;
+}
+
+common::Object VM::Import(size_t module, const uint8_t* ip)
+{
+  const scanner::Token* name = GetToken(ip);
+  switch (modules_.GetState(module))
+  {
+    case interpreter::ModuleTable::State::DONE:
+      return modules_.Get(module);
+    case interpreter::ModuleTable::State::RUNNING:
+      Fail(ip, "Circular import of \"" + name->ToRawString() + "\".");
+    case interpreter::ModuleTable::State::NOT_RUN:
+      break;
+  }
+  if (!loader_)
+  {
+    Fail(ip, "Can not import \"" + name->ToRawString() + "\".");
+  }
+  modules_.SetRunning(module);
+
+  if (module >= module_protos_.size())
+  {
+    module_protos_.resize(module + 1);
+  }
+  std::shared_ptr<FunctionProto>& script = module_protos_[module];
+  if (!script)
+  {
+    script = Compiler(loader_->GetResolution()).Compile(loader_->GetStatements(module));
+  }
+
+  if (frames_.size() == kMaxFrames || GetStackRoom() < script->max_stack_)
+  {
+    Fail(ip, "Stack overflow.");
+  }
+
+  // Modules have globals of their own, which their functions capture.
+  interpreter::Environment* globals = heap_.Allocate<interpreter::Environment>();
+  DefineBuiltins(*globals);
+  size_t exit_depth = frames_.size();
+  frames_.push_back({script.get(), script->chunk_.GetCode(), sp_, globals, pool_.Size()});
+  Run(exit_depth);
+  Pop();
+
+  return modules_.Finish(heap_, module, *name, *globals, loader_->GetExports(module));
+}
+
+const util::SourceFile& VM::GetFile(const scanner::Token& token) const
+{
+  const util::SourceFile* file = loader_ ? loader_->FindFile(token.GetLexeme().data()) : nullptr;
+  return file ? *file : kFile;
+}
+
+const scanner::Token* VM::GetToken(const uint8_t* ip) const
+{
+  const Chunk& chunk = frames_.back().proto->chunk_;
+  return chunk.FindToken(ip - chunk.GetCode());
+}
+
+void VM::Fail(const uint8_t* ip, const std::string& message)
+{
+  const scanner::Token* token = GetToken(ip);
+  if (token)
+  {
+    throw interpreter::InterpretError(*token, message);
+  }
+  throw std::runtime_error(message);
+}
+
+// Non-numeric operands of the arithmetic and comparison instructions; same
+// semantics as Interpreter::EvaluateArithmetic().
+common::Object VM::Binary(Op op, const uint8_t* ip, common::Object& left, common::Object& right)
+{
+  if (op == Op::DIVIDE && left.GetType() == common::Object::INT && right.GetType() == common::Object::INT)
+  {
+    Fail(ip, interpreter::operators::GetDivisionError(right.AsInt()));
+  }
+  if (left.GetType() == common::Object::STRING || right.GetType() == common::Object::STRING)
+  {
+    if (op == Op::ADD)
+    {
+      return heap_.MakeString(left.ToString() + right.ToString());
+    }
+    Fail(ip, left.GetTypeName() + " and " + right.GetTypeName() + " are not valid for +.");
+  }
+
+  const scanner::Token* token = GetToken(ip);
+  Fail(ip, left.GetTypeName() + " and " + right.GetTypeName() + " are not valid for " +
+           (token ? token->ToRawString() : GetOpName(op)));
+}
+
+#if INTERP_VM_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+void VM::Run(size_t exit_depth)
+{
+  Frame* frame = &frames_.back();
+  const uint8_t* ip = frame->ip;
+
+#define INTERP_READ_U8() (*ip++)
+#define INTERP_READ_U16() (ip += 2, static_cast<size_t>(ip[-2] | (ip[-1] << 8)))
+#define INTERP_READ_U32() \
+  (ip += 4, static_cast<size_t>(static_cast<uint32_t>(ip[-4]) | (static_cast<uint32_t>(ip[-3]) << 8) | \
+                                (static_cast<uint32_t>(ip[-2]) << 16) | (static_cast<uint32_t>(ip[-1]) << 24)))
+
+#if INTERP_VM_COMPUTED_GOTO
+  static void* kDispatch[] = {
+#define INTERP_PUT_LABEL_ADDRESS(_) &&op_##_,
+    INTERP_FORALL_OPCODES(INTERP_PUT_LABEL_ADDRESS)
+#undef INTERP_PUT_LABEL_ADDRESS
+  };
+#define INTERP_CASE(name) op_##name
+#define INTERP_DISPATCH() goto *kDispatch[*ip++]
+  INTERP_DISPATCH();
+#else
+#define INTERP_CASE(name) case Op::name
+#define INTERP_DISPATCH() continue
+  while (true)
+  {
+  switch (static_cast<Op>(*ip++))
+  {
+#endif
+
+  INTERP_CASE(CONSTANT):
+  {
+    Push(frame->proto->chunk_.GetConstant(INTERP_READ_U16()));
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(CONSTANT_WIDE):
+  {
+    Push(frame->proto->chunk_.GetConstant(INTERP_READ_U32()));
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(NONE):
+  {
+    Push(common::MakeNone());
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(TRUE):
+  {
+    Push(common::MakeBool(true));
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(FALSE):
+  {
+    Push(common::MakeBool(false));
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(POP):
+  {
+    --sp_;
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(DEFINE):
+  {
+    frame->env->Define(Pop(), heap_);
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(GET_VAR):
+  {
+    size_t depth = INTERP_READ_U16();
+    size_t slot = INTERP_READ_U16();
+    Push(frame->env->GetAt(depth, slot));
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(SET_VAR):
+  {
+    size_t depth = INTERP_READ_U16();
+    size_t slot = INTERP_READ_U16();
+    frame->env->GetAt(depth, slot) = sp_[-1];
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(GET_VAR_WIDE):
+  {
+    size_t depth = INTERP_READ_U32();
+    size_t slot = INTERP_READ_U32();
+    Push(frame->env->GetAt(depth, slot));
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(SET_VAR_WIDE):
+  {
+    size_t depth = INTERP_READ_U32();
+    size_t slot = INTERP_READ_U32();
+    frame->env->GetAt(depth, slot) = sp_[-1];
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(UNRESOLVED):
+  {
+    common::Symbol name = frame->proto->chunk_.GetName(INTERP_READ_U32());
+    throw std::runtime_error("Unresolved identifier \"" + common::GetSymbolName(name) + "\"");
+  }
+
+// The _WIDE variants differ only in reading their operands with read.
+#define INTERP_GET_PROPERTY_CASE(op, read) \
+  INTERP_CASE(op): \
+  { \
+    common::Symbol name = frame->proto->chunk_.GetName(read()); \
+    interpreter::InlineCache& cache = frame->proto->chunk_.GetCache(read()); \
+    common::Object& obj = sp_[-1]; \
+    if (obj.GetType() != common::Object::INSTANCE) \
+    { \
+      throw std::runtime_error("Expected <instance> before \".\""); \
+    } \
+    obj = cache.GetProperty(obj, name); \
+    INTERP_DISPATCH(); \
+  }
+
+#define INTERP_SET_PROPERTY_CASE(op, read) \
+  INTERP_CASE(op): \
+  { \
+    common::Symbol name = frame->proto->chunk_.GetName(read()); \
+    interpreter::InlineCache& cache = frame->proto->chunk_.GetCache(read()); \
+    common::Object value = Pop(); \
+    common::Object& obj = sp_[-1]; \
+    if (obj.GetType() != common::Object::INSTANCE) \
+    { \
+      throw std::runtime_error("Expected <instance> before \".\""); \
+    } \
+    cache.SetProperty(obj, name, value, heap_); \
+    obj = value; \
+    INTERP_DISPATCH(); \
+  }
+
+// "super" and "this" are the only variables of their environments.
+#define INTERP_GET_SUPER_CASE(op, read) \
+  INTERP_CASE(op): \
+  { \
+    size_t depth = read(); \
+    common::Symbol name = frame->proto->chunk_.GetName(read()); \
+    interpreter::InlineCache& cache = frame->proto->chunk_.GetCache(read()); \
+    common::Object& super = frame->env->GetAt(depth, 0); \
+    common::Object& this_instance = frame->env->GetAt(depth - 1, 0); \
+    Push(cache.GetSuperMethod(super, this_instance, name)); \
+    INTERP_DISPATCH(); \
+  }
+
+  INTERP_GET_PROPERTY_CASE(GET_PROPERTY, INTERP_READ_U16)
+  INTERP_SET_PROPERTY_CASE(SET_PROPERTY, INTERP_READ_U16)
+  INTERP_GET_SUPER_CASE(GET_SUPER, INTERP_READ_U16)
+  INTERP_GET_PROPERTY_CASE(GET_PROPERTY_WIDE, INTERP_READ_U32)
+  INTERP_SET_PROPERTY_CASE(SET_PROPERTY_WIDE, INTERP_READ_U32)
+  INTERP_GET_SUPER_CASE(GET_SUPER_WIDE, INTERP_READ_U32)
+#undef INTERP_GET_PROPERTY_CASE
+#undef INTERP_SET_PROPERTY_CASE
+#undef INTERP_GET_SUPER_CASE
+
+  INTERP_CASE(EQUAL):
+  {
+    sp_[-2] = common::MakeBool(sp_[-2].IsEqual(sp_[-1]));
+    --sp_;
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(NOT_EQUAL):
+  {
+    sp_[-2] = common::MakeBool(!sp_[-2].IsEqual(sp_[-1]));
+    --sp_;
+    INTERP_DISPATCH();
+  }
+
+// Opcode names match parser::BinaryOp.
+#define INTERP_BINARY_CASE(name) \
+  INTERP_CASE(name): \
+  { \
+    common::Object& l = sp_[-2]; \
+    if (!interpreter::operators::ApplyNumeric<parser::BinaryOp::name>(l, sp_[-1], l)) \
+    { \
+      l = Binary(Op::name, ip - 1, l, sp_[-1]); \
+    } \
+    --sp_; \
+    INTERP_DISPATCH(); \
+  }
+
+  INTERP_BINARY_CASE(GREATER)
+  INTERP_BINARY_CASE(GREATER_EQUAL)
+  INTERP_BINARY_CASE(LESS)
+  INTERP_BINARY_CASE(LESS_EQUAL)
+  INTERP_BINARY_CASE(ADD)
+  INTERP_BINARY_CASE(SUBTRACT)
+  INTERP_BINARY_CASE(MULTIPLY)
+  INTERP_BINARY_CASE(DIVIDE)
+#undef INTERP_BINARY_CASE
+
+  INTERP_CASE(NOT):
+  {
+    sp_[-1] = common::MakeBool(!interpreter::operators::IsTruthy(sp_[-1]));
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(NEGATE):
+  {
+    common::Object& obj = sp_[-1];
+    switch (obj.GetType())
+    {
+      case common::Object::INT:
+        obj = common::MakeInt(-obj.AsInt());
+        break;
+      case common::Object::FLOAT:
+        obj = common::MakeFloat(-obj.AsFloat());
+        break;
+      default:
+      {
+        const scanner::Token* token = GetToken(ip - 1);
+        Fail(ip - 1, "Int or Float expected before " + (token ? token->ToString() : GetOpName(Op::NEGATE)));
+      }
+    }
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(JUMP):
+  {
+    size_t offset = INTERP_READ_U32();
+    ip += offset;
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(JUMP_IF_FALSE):
+  {
+    size_t offset = INTERP_READ_U32();
+    if (!interpreter::operators::IsTruthy(sp_[-1]))
+    {
+      ip += offset;
+    }
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(JUMP_IF_TRUE):
+  {
+    size_t offset = INTERP_READ_U32();
+    if (interpreter::operators::IsTruthy(sp_[-1]))
+    {
+      ip += offset;
+    }
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(LOOP):
+  {
+    size_t offset = INTERP_READ_U32();
+    ip -= offset;
+    heap_.Safepoint();
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(CALL):
+  {
+    // Loops and calls are the only ways to run for long without passing
+    // through here.
+    heap_.Safepoint();
+    size_t argc = INTERP_READ_U8();
+    common::Object& callee = sp_[-static_cast<ptrdiff_t>(argc) - 1];
+    common::ICallable& func = callee.AsCallable();
+    if (func.GetArity() != argc)
+    {
+      throw std::runtime_error("Wrong arity");
+    }
+
+    if (const Closure* closure = dynamic_cast<const Closure*>(&func))
+    {
+      frame->ip = ip;
+      PushFrame(*closure, argc);
+      frame = &frames_.back();
+      ip = frame->ip;
+      INTERP_DISPATCH();
+    }
+
+    // Native code may call back into the VM, which reports errors at ip.
+    frame->ip = ip;
+
+    // Computed goto does not run destructors, so locals that own memory must
+    // go out of scope before dispatching.
+    common::Object result;
+    {
+      std::vector<common::Object> args(sp_ - argc, sp_);
+      result = func.Call(args);
+    }
+    sp_ -= argc;
+    sp_[-1] = std::move(result);
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(RETURN):
+  {
+    common::Object result = Pop();
+    sp_ = frame->base;
+    pool_.Truncate(frame->pool_base);
+    frames_.pop_back();
+    Push(std::move(result));
+    if (frames_.size() == exit_depth)
+    {
+      return;
+    }
+    frame = &frames_.back();
+    ip = frame->ip;
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(FUNCTION):
+  {
+    const auto& proto = frame->proto->chunk_.GetFunction(INTERP_READ_U16());
+    Push(common::MakeCallable(heap_.Allocate<Closure>(*this, proto, frame->env)));
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(CLASS):
+  {
+    const Chunk& chunk = frame->proto->chunk_;
+    common::Symbol name = chunk.GetName(INTERP_READ_U32());
+    bool has_super = INTERP_READ_U8();
+    size_t num_methods = INTERP_READ_U16();
+
+    common::Object super = common::MakeNone();
+    if (has_super)
+    {
+      super = Pop();
+      super.AssumeType(common::Object::CLASS);
+    }
+
+    size_t slot = frame->env->Define(common::MakeNone(), heap_);
+
+    interpreter::Environment* methods_env = frame->env;
+    if (has_super)
+    {
+      methods_env = heap_.Allocate<interpreter::Environment>(frame->env);
+      methods_env->Define(super, heap_);
+    }
+
+    interpreter::ClassImpl* ptr;
+    {
+      interpreter::ClassImpl::Methods methods;
+      for (size_t i = 0; i < num_methods; ++i)
+      {
+        const auto& proto = chunk.GetFunction(INTERP_READ_U16());
+        auto fn = heap_.Allocate<Closure>(*this, proto, methods_env);
+        methods[proto->name_] = common::MakeCallable(fn);
+      }
+      ptr = heap_.Allocate<interpreter::ClassImpl>(heap_, common::GetSymbolName(name), super, methods);
+    }
+    frame->env->GetAt(0, slot) = common::MakeClass(ptr);
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(IMPORT):
+  {
+    size_t module = INTERP_READ_U16();
+    frame->ip = ip;
+    common::Object obj = Import(module, ip - 3);
+    Push(obj);
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(PUSH_ENV):
+  {
+    bool pooled = INTERP_READ_U8();
+    frame->env = pooled ? pool_.Push(frame->env) : heap_.Allocate<interpreter::Environment>(frame->env);
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(POP_ENV):
+  {
+    if (INTERP_READ_U8())
+    {
+      pool_.Pop();
+    }
+    frame->env = frame->env->GetParentEnvironment();
+    INTERP_DISPATCH();
+  }
+  INTERP_CASE(PRINT):
+  {
+    out_ << Pop().ToString() << "\n";
+    INTERP_DISPATCH();
+  }
+
+#if !INTERP_VM_COMPUTED_GOTO
+  }
+  }
+#endif
+
+#undef INTERP_CASE
+#undef INTERP_DISPATCH
+#undef INTERP_READ_U8
+#undef INTERP_READ_U16
+#undef INTERP_READ_U32
+}
+
+#if INTERP_VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+} // namespace vm
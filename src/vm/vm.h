@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "common/callable.h"
+#include "common/heap.h"
+#include "common/object.h"
+#include "interpreter/environment.h"
+#include "chunk.h"
+#include "interpreter/module_table.h"
+#include "resolver/module_loader.h"
+#include "util/source_file.h"
+
+namespace vm
+{
+
+class VM;
+
+class Closure: public common::ICallable
+{
+public:
+  Closure() = delete;
+
+  Closure(VM& vm,
+          std::shared_ptr<const FunctionProto> proto,
+          interpreter::Environment* env)
+    : vm_(vm),
+      proto_(proto),
+      env_(env)
+  {}
+
+  common::Object Call(std::vector<common::Object>& args) const override;
+
+  std::string GetName() const override
+  {
+    return common::GetSymbolName(proto_->name_);
+  }
+
+  size_t GetArity() const override
+  {
+    return proto_->arity_;
+  }
+
+  common::ICallable* Bind(common::Object instance) const override;
+
+  void Trace(common::Heap& heap) const override
+  {
+    heap.Mark(env_);
+  }
+
+  const FunctionProto& GetProto() const { return *proto_; }
+
+  interpreter::Environment* GetEnv() const { return env_; }
+
+private:
+  VM& vm_;
+  std::shared_ptr<const FunctionProto> proto_;
+  interpreter::Environment* env_;
+};
+
+class VM
+{
+public:
+  // file is the source the scripts were compiled from; runtime errors are
+  // reported at their position in it. loader provides the imported modules
+  // and completes functions that a lazy parse skipped. The script prints to
+  // out; runtime errors go to err.
+  explicit VM(const util::SourceFile& file,
+              resolver::IModuleLoader* loader = nullptr,
+              std::ostream& out = std::cout,
+              std::ostream& err = std::cerr);
+
+  void Interpret(std::shared_ptr<const FunctionProto> script);
+
+  // Runs closure to completion; used when native code calls back into the VM.
+  common::Object Call(const Closure& closure, std::vector<common::Object>& args);
+
+  common::Heap& GetHeap() { return heap_; }
+
+private:
+  static constexpr size_t kStackSize = FunctionProto::kMaxStack;
+  static constexpr size_t kMaxFrames = 1 << 12;
+  // CALL and its argument count.
+  static constexpr size_t kCallSize = 2;
+
+  struct Frame
+  {
+    const FunctionProto* proto;
+    const uint8_t* ip;
+    common::Object* base;
+    interpreter::Environment* env;
+    // Size of pool_ when the frame was entered.
+    size_t pool_base;
+  };
+
+  const util::SourceFile& kFile;
+  resolver::IModuleLoader* loader_;
+  std::ostream& out_;
+  std::ostream& err_;
+  common::Heap heap_;
+  // Environments of functions and blocks without closures.
+  interpreter::FrameStack pool_;
+  std::vector<common::Object> stack_;
+  common::Object* sp_;
+  std::vector<Frame> frames_;
+  interpreter::Environment* globals_;
+  interpreter::ModuleTable modules_;
+  // Compiled modules, by module index.
+  std::vector<std::shared_ptr<FunctionProto>> module_protos_;
+
+  void Run(size_t exit_depth);
+
+  // Drops the frames and the stack of a run that failed.
+  void Reset();
+
+  // The live part of the stack, frame environments and globals.
+  void TraceRoots(common::Heap& heap);
+
+  // Free slots of the stack.
+  size_t GetStackRoom() const
+  {
+    return stack_.data() + stack_.size() - sp_;
+  }
+
+  void Push(common::Object obj)
+  {
+    if (sp_ == stack_.data() + stack_.size())
+    {
+      throw std::runtime_error("Stack overflow");
+    }
+    *sp_++ = std::move(obj);
+  }
+
+  common::Object Pop()
+  {
+    return std::move(*--sp_);
+  }
+
+  // Arguments are the argc objects on top of the stack, the callee is below.
+  void PushFrame(const Closure& closure, size_t argc);
+
+  // Parses and compiles the body of proto on its first call.
+  void Load(const FunctionProto& proto);
+
+  void DefineBuiltins(interpreter::Environment& globals);
+
+  // The object of module, which is compiled and run first if this is its
+  // first import. ip points at the IMPORT instruction.
+  common::Object Import(size_t module, const uint8_t* ip);
+
+  // The source file the token is from.
+  const util::SourceFile& GetFile(const scanner::Token& token) const;
+
+  // ip points at the opcode of the instruction.
+  common::Object Binary(Op op, const uint8_t* ip, common::Object& left, common::Object& right);
+
+  const scanner::Token* GetToken(const uint8_t* ip) const;
+
+  [[noreturn]] void Fail(const uint8_t* ip, const std::string& message);
+};
+
+} // namespace vm